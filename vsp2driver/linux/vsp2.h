@@ -67,6 +67,12 @@
  * VIDIOC_VSP2_LUT_CONFIG - Configure the lookup table
  * VIDIOC_VSP2_CLU_CONFIG - Configure the 3D lookup table
  * VIDIOC_VSP2_HGO_CONFIG - Configure the Histogram Generator -One dimension
+ * VIDIOC_VSP2_HGT_CONFIG - Configure the Histogram Generator -Two dimension
+ * VIDIOC_VSP2_BRU_COMPOSE - Blend up to VSP2_COMPOSE_MAX_LAYERS layers (bru)
+ * VIDIOC_VSP2_LUT_DMABUF - Configure the lookup table from a dmabuf
+ * VIDIOC_VSP2_CLU_DMABUF - Configure the 3D lookup table from a dmabuf
+ * VIDIOC_VSP2_CLU_BANK_LOAD - Load a 3D lookup table bank
+ * VIDIOC_VSP2_ADDR_UNREGISTER - Release user memory pinned for the tables
  */
 
 #define VIDIOC_VSP2_LUT_CONFIG \
@@ -81,10 +87,49 @@
 #define VIDIOC_VSP2_HGT_CONFIG \
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 4, struct vsp2_hgt_config)
 
+#define VIDIOC_VSP2_BRU_COMPOSE \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 5, struct vsp2_compose_config)
+
+#define VIDIOC_VSP2_LUT_DMABUF \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 6, struct vsp2_lut_dmabuf_config)
+
+#define VIDIOC_VSP2_CLU_DMABUF \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 7, struct vsp2_clu_dmabuf_config)
+
+#define VIDIOC_VSP2_CLU_BANK_LOAD \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 8, struct vsp2_clu_bank_config)
+
+#define VIDIOC_VSP2_ADDR_UNREGISTER \
+	_IOW('V', BASE_VIDIOC_PRIVATE + 9, struct vsp2_addr_config)
+
 /*
  * Private IOCTL configs
  */
 
+/*
+ * Unless the driver is built with USE_BUFFER, the LUT, CLU, HGO and HGT user
+ * memory is used by the hardware without copies. It is pinned on first use
+ * and stays pinned, for later configurations at the same address, until it
+ * is unregistered with VIDIOC_VSP2_ADDR_UNREGISTER on any of these subdevs
+ * or the process closes its last file handle on them. At most 32 addresses
+ * are kept registered per process, further ones are unpinned as soon as the
+ * tables using them are replaced. The memory must be contiguous in the
+ * device address space.
+ */
+struct vsp2_addr_config {
+	void		*addr;	/* address passed to the config ioctls */
+};
+
+/*
+ * With USE_BUFFER, the table is copied when VIDIOC_VSP2_LUT_CONFIG is
+ * called, the user memory can be reused as soon as the ioctl returns.
+ * Otherwise the hardware reads the table in place from the pinned user
+ * memory, which must not be modified until the table has been replaced and
+ * the frames processed with it have been dequeued. The ioctl may be called
+ * while streaming, the new table is then used from the next frame on. It
+ * returns -EBUSY when all the table slots are still being read by the
+ * hardware.
+ */
 struct vsp2_lut_config {
 	void		*addr;	/* Allocate memory size is tbl_num * 8 bytes. */
 	unsigned short	tbl_num;	/* 1 to 256 */
@@ -104,6 +149,48 @@ struct vsp2_clu_config {
 	unsigned short	tbl_num;	/* 1 to 9826 */
 };
 
+/*
+ * The dmabuf variants hand the table memory to the hardware without copying
+ * it. The dmabuf must be contiguous in the device address space and must not
+ * be written while the hardware may read it. The driver keeps a reference to
+ * the dmabuf until the table is replaced. The 3D lookup table can't be
+ * replaced while streaming.
+ */
+struct vsp2_lut_dmabuf_config {
+	int		fd;		/* dmabuf file descriptor */
+	unsigned int	offset;		/* offset of the table in the dmabuf */
+	unsigned short	tbl_num;	/* 1 to 256 */
+	unsigned char	fxa;
+};
+
+struct vsp2_clu_dmabuf_config {
+	int		fd;		/* dmabuf file descriptor */
+	unsigned int	offset;		/* offset of the table in the dmabuf */
+	unsigned char	mode;
+	unsigned char	fxa;
+	unsigned short	tbl_num;	/* 1 to 9826 */
+};
+
+/*
+ * The 3D lookup table banks are copied to kernel memory once and selected
+ * with VSP2_CID_CLU_BANK. Banks can't be loaded while streaming.
+ */
+#define VSP2_CLU_NUM_BANKS	(8)
+
+struct vsp2_clu_bank_config {
+	unsigned int	bank;		/* 0 to VSP2_CLU_NUM_BANKS - 1 */
+	struct vsp2_clu_config config;
+};
+
+/*
+ * The HGO histograms can also be captured per frame from the "hgo histo"
+ * metadata video node, in the V4L2_META_FMT_VSP2_HGO format. Its buffers
+ * have the layout of the VIDIOC_VSP2_HGO_CONFIG memory and carry the
+ * sequence number of the frame. The addr field of struct vsp2_hgo_config is
+ * ignored while the video node is streaming.
+ */
+#define V4L2_META_FMT_VSP2_HGO	v4l2_fourcc('V', '2', 'H', 'O')
+
 struct vsp2_hgo_config {
 	void __user	*addr;	/* Allocate memory size is 1088 bytes. */
 	unsigned short	width;	/* horizontal size */
@@ -121,6 +208,13 @@ struct vsp2_hue_area {
 	unsigned char upper;
 };
 
+/*
+ * The HGT histograms can also be captured continuously from the "hgt histo"
+ * metadata video node, in the V4L2_META_FMT_VSP2_HGT format, with the same
+ * rules as the HGO.
+ */
+#define V4L2_META_FMT_VSP2_HGT	v4l2_fourcc('V', '2', 'H', 'T')
+
 struct vsp2_hgt_config {
 	void __user	*addr;	/* Allocate memory size is 800 bytes. */
 	unsigned short	width;	/* horizontal size */
@@ -129,6 +223,41 @@ struct vsp2_hgt_config {
 	unsigned long	sampling;	/* sampling module */
 };
 
+/*
+ * Composition
+ *
+ * Layers are listed from bottom to top and blended over the background color
+ * into the destination. All buffers are V4L2_PIX_FMT_ARGB32 dmabufs that must
+ * be physically contiguous. Layers are blended in several passes when there
+ * are more layers than BRU inputs, the composition returns when the
+ * destination is complete. The BRU must not be part of a streaming pipeline.
+ * Each pass waits for a free VSPM channel when all of them are used by other
+ * streaming pipelines.
+ */
+#define VSP2_COMPOSE_MAX_LAYERS	(16)
+
+struct vsp2_compose_buffer {
+	int		fd;		/* dmabuf file descriptor */
+	unsigned int	offset;		/* offset of the image in the dmabuf */
+	unsigned short	stride;		/* bytes per line */
+	unsigned short	width;		/* horizontal size */
+	unsigned short	height;		/* vertical size */
+};
+
+struct vsp2_compose_layer {
+	struct vsp2_compose_buffer buf;
+	unsigned short	left;		/* position in the destination */
+	unsigned short	top;
+	unsigned char	alpha;		/* layer alpha, 255 for opaque */
+};
+
+struct vsp2_compose_config {
+	unsigned int	num_layers;	/* 1 to VSP2_COMPOSE_MAX_LAYERS */
+	struct vsp2_compose_layer layers[VSP2_COMPOSE_MAX_LAYERS];
+	struct vsp2_compose_buffer dst;
+	unsigned int	bgcolor;	/* background color, RGB888 */
+};
+
 /* HGO,HGT sampling module */
 /*
  * Use the following value to sampling module in application.
@@ -151,6 +280,236 @@ enum vsp2_ctrl_id {
 	VSP2_CID_COMPRESS = V4L2_CID_PRIVATE_BASE,
 };
 
+/*
+ * Subdevice controls
+ *
+ * VSP2_CID_SPLIT - (wpf) Split each frame into left and right halves
+ *                  processed concurrently on two VSPM channels. Requires at
+ *                  least two channels in renesas,#ch, a single RPF, no
+ *                  BRU/BRS and no rotation. The HGO and HGT are disabled
+ *                  for split frames. VSPM can't set the UDS initial phase,
+ *                  the right half is scaled from the input pixel closest to
+ *                  the full frame sampling grid, output pixels next to the
+ *                  split can differ slightly from an unsplit frame.
+ * VSP2_CID_DAMAGE - (wpf) Up to VSP2_DAMAGE_MAX_RECTS rectangles, as
+ *                   { left, top, width, height } in output pixels, bounding
+ *                   the parts of the next queued output buffers that need to
+ *                   be recomposed. Jobs are limited to the union of the
+ *                   rectangles, the rest of the output buffer is left
+ *                   untouched. Empty rectangles are ignored, no rectangle
+ *                   selects the full frame. The rectangles are latched when
+ *                   an output buffer is queued and only apply to pipelines
+ *                   with a BRU or BRS, without UDS and without rotation.
+ *                   The full frame is processed when VSP2_CID_BLEND selects
+ *                   another mode than alpha blending, or when an input
+ *                   outside of the rectangles uses VSP2_CID_CKEY.
+ * VSP2_CID_VIR - (rpf) Generate a solid color layer instead of reading
+ *                memory. The layer size is the RPF sink crop size and its
+ *                video node must not be streamed. Can't be changed while
+ *                the RPF is part of a streaming pipeline.
+ * VSP2_CID_VIR_COLOR - (rpf) Color of the virtual layer as 0xRRGGBB or
+ *                      0xYYUUVV, matching the RPF source pad format. The
+ *                      alpha is taken from V4L2_CID_ALPHA_COMPONENT.
+ * VSP2_CID_ZPOS - (rpf) Stacking position of the layer in the BRU/BRS,
+ *                 0 being the bottom. Layers with the same position are
+ *                 stacked by RPF index. Applied from the next job on,
+ *                 defaults to the RPF index.
+ * VSP2_CID_CKEY - (rpf) Color key mode, one of VSP2_CKEY_*. Pixels matching
+ *                 the key get the alpha value of the key color they match.
+ *                 Applied at stream start.
+ * VSP2_CID_CKEY_COLOR - (rpf) Two key colors as 0xAARRGGBB or 0xAAYYUUVV,
+ *                       matching the RPF source pad format, AA being the
+ *                       alpha given to matching pixels. In range mode the
+ *                       first color is the lower bound and the second one
+ *                       the upper bound, and the first alpha is used.
+ *                       Applied at stream start.
+ * VSP2_CID_MULT - (rpf) Multiplication unit mode, one of VSP2_MULT_*. The
+ *                 ratio is the V4L2_CID_ALPHA_COMPONENT value. The
+ *                 premultiply modes multiply the colors by the pixel alpha
+ *                 while reading, and the BRU/BRS then blends the layer as
+ *                 premultiplied. Only applies to RGB source formats, YUV
+ *                 inputs are passed through.
+ * VSP2_CID_UDS_FILTER - (uds) Interpolation filter, one of
+ *                       VSP2_UDS_FILTER_*. The default automatic mode uses
+ *                       multi-tap, or bilinear when alpha is scaled.
+ *                       Multi-tap gives the best quality, it interpolates
+ *                       from more than two neighbouring pixels in each
+ *                       direction, but can't be combined with alpha scaling
+ *                       and falls back to bilinear when the input has an
+ *                       alpha channel. Bilinear interpolates from the 2x2
+ *                       nearest pixels and is softer. Nearest neighbour
+ *                       reads a single pixel, it is blocky but keeps pixel
+ *                       values unchanged, which suits label and index
+ *                       images. The UDS is pipelined at one pixel per clock
+ *                       with all filters, the taps are computed in parallel
+ *                       from its line memory: the frame processing time is
+ *                       set by the larger of the input and output sizes and
+ *                       memory bandwidth by the input and output sizes, the
+ *                       filter changes neither.
+ * VSP2_CID_UDS_CLIP - (uds) Clip the scaled pixel components to the valid
+ *                     range, avoiding overshoot of the multi-tap filter on
+ *                     sharp edges.
+ * VSP2_CID_UDS_ALPHA_THRES - (uds) Alpha thresholds 0 and 1 used to
+ *                            binarize the scaled alpha channel into the
+ *                            three alpha values of the pipeline. Both set to
+ *                            0 keep the scaled alpha.
+ * VSP2_CID_CROP_FRAC - (rpf) Fractional parts of the crop width and height
+ *                      in 1/65536 pixel units. The RPF still reads the
+ *                      whole-pixel crop rectangle, but a UDS fed by the RPF
+ *                      computes its scaling ratio from the exact size, so
+ *                      that tiles or zoom steps scaled separately use the
+ *                      same ratio as the full image. The fractions are
+ *                      scaled along with the crop rectangle when an SRU
+ *                      sits between the RPF and the UDS.
+ * VSP2_CID_SRU_INTENSITY - (sru) Super-resolution intensity, from 1 (weakest)
+ *                          to 6. The SRU upscales by 2 when its source pad
+ *                          size is twice its sink pad size, and only
+ *                          enhances the image otherwise.
+ * VSP2_CID_SHP_GAIN - (shp) Sharpening gain of the high and medium frequency
+ *                     bands, in that order. 0 on both bands disables the
+ *                     sharpening.
+ * VSP2_CID_SHP_CORING - (shp) Coring threshold of each band, detail below
+ *                       the threshold is treated as noise and not
+ *                       amplified.
+ * VSP2_CID_SHP_LIMIT - (shp) Limit of the enhancement added to each pixel by
+ *                      each band, to avoid halos around strong edges.
+ * VSP2_CID_CLU_BANK - (clu) Table bank used by the CLU, loaded beforehand
+ *                     with VIDIOC_VSP2_CLU_BANK_LOAD. -1 selects the table
+ *                     set with VIDIOC_VSP2_CLU_CONFIG or
+ *                     VIDIOC_VSP2_CLU_DMABUF. Can be changed while
+ *                     streaming, the switch happens between two frames.
+ * VSP2_CID_HGT_OFFSET - (hgt) Horizontal and vertical offset of the
+ *                       histogram area in the frame, the area size being
+ *                       given by VIDIOC_VSP2_HGT_CONFIG. Applied at stream
+ *                       start, which fails with -EINVAL if the area doesn't
+ *                       fit in the frames of the pipeline.
+ * VSP2_CID_HGT_SKIP - (hgt) Horizontal and vertical pixel skipping, one of
+ *                     VSP2_HGT_SKIP_* each, to sample a subset of the area.
+ *                     Applied at stream start.
+ * VSP2_CID_HGT_INTERVAL - (hgt) Capture the histogram of one frame out of N
+ *                         on the histogram video node.
+ * VSP2_CID_LUT_AUTO - (lut) Compute the table in the driver from the HGO
+ *                     histogram of each frame, one of VSP2_LUT_AUTO_*. The
+ *                     table is used from the next frame on and replaces the
+ *                     tables set with VIDIOC_VSP2_LUT_CONFIG. The HGO must
+ *                     sample the image before the LUT, and its histogram
+ *                     video node must be streaming unless the driver is
+ *                     built with USE_BUFFER.
+ * VSP2_CID_LUT_AUTO_CLIP - (lut) Share of the darkest and brightest pixels,
+ *                          in 1/1000 units, saturated by
+ *                          VSP2_LUT_AUTO_STRETCH.
+ * VSP2_CID_LUT_AUTO_SMOOTH - (lut) Weight of the previous table, in 1/16
+ *                            units, when blending it with the table
+ *                            computed from the last histogram. 0 disables
+ *                            the temporal smoothing.
+ * VSP2_CID_BLEND - (bru, brs) Parameters of the Blend/ROP unit of each sink
+ *                  pad, as an array of [pads][VSP2_BLEND_NUM_PARAMS] bytes
+ *                  indexed by enum vsp2_blend_param. The parameters follow
+ *                  their layer when it is restacked with VSP2_CID_ZPOS.
+ *                  Applied at stream start, all zeroes select the default
+ *                  alpha blending.
+ */
+/*
+ * Driver private subdevice controls. The control framework refuses IDs from
+ * V4L2_CID_PRIVATE_BASE on, they are numbered from the top of the user class
+ * instead, away from the blocks reserved upstream for other drivers.
+ */
+#define VSP2_CID_PRIVATE_BASE	(V4L2_CID_USER_BASE | 0x1f00)
+
+#define VSP2_DAMAGE_MAX_RECTS	(8)
+
+enum vsp2_subdev_ctrl_id {
+	VSP2_CID_SPLIT = VSP2_CID_PRIVATE_BASE,
+	VSP2_CID_DAMAGE,
+	VSP2_CID_VIR,
+	VSP2_CID_VIR_COLOR,
+	VSP2_CID_ZPOS,
+	VSP2_CID_BLEND,
+	VSP2_CID_CKEY,
+	VSP2_CID_CKEY_COLOR,
+	VSP2_CID_MULT,
+	VSP2_CID_UDS_FILTER,
+	VSP2_CID_UDS_CLIP,
+	VSP2_CID_UDS_ALPHA_THRES,
+	VSP2_CID_CROP_FRAC,
+	VSP2_CID_SRU_INTENSITY,
+	VSP2_CID_SHP_GAIN,
+	VSP2_CID_SHP_CORING,
+	VSP2_CID_SHP_LIMIT,
+	VSP2_CID_CLU_BANK,
+	VSP2_CID_HGT_OFFSET,
+	VSP2_CID_HGT_SKIP,
+	VSP2_CID_HGT_INTERVAL,
+	VSP2_CID_LUT_AUTO,
+	VSP2_CID_LUT_AUTO_CLIP,
+	VSP2_CID_LUT_AUTO_SMOOTH,
+};
+
+#define VSP2_CKEY_OFF		(0)	/* no color key (default) */
+#define VSP2_CKEY_COLOR		(1)	/* match either key color */
+#define VSP2_CKEY_RANGE		(2)	/* match the range between the colors */
+
+#define VSP2_HGT_SKIP_OFF	(0)	/* every pixel (default) */
+#define VSP2_HGT_SKIP_1_2	(1)	/* every other pixel */
+#define VSP2_HGT_SKIP_1_4	(2)	/* one pixel out of four */
+
+#define VSP2_LUT_AUTO_OFF	(0)	/* tables set by the user (default) */
+#define VSP2_LUT_AUTO_EQUALIZE	(1)	/* histogram equalisation */
+#define VSP2_LUT_AUTO_STRETCH	(2)	/* percentile contrast stretch */
+
+#define VSP2_MULT_AUTO		(0)	/* from the format flags (default) */
+#define VSP2_MULT_THROUGH	(1)	/* no multiplication */
+#define VSP2_MULT_RATIO		(2)	/* alpha multiplied by the ratio */
+#define VSP2_MULT_PREMUL	(3)	/* colors multiplied by the alpha */
+#define VSP2_MULT_PREMUL_RATIO	(4)	/* both of the above */
+
+#define VSP2_UDS_FILTER_AUTO		(0)	/* multi-tap if possible */
+#define VSP2_UDS_FILTER_BILINEAR	(1)
+#define VSP2_UDS_FILTER_NEAREST		(2)
+#define VSP2_UDS_FILTER_MULTITAP	(3)
+
+/*
+ * Blend/ROP unit parameters
+ *
+ * In VSP2_BLEND_MODE_BLEND the unit computes with formula 0
+ *
+ *	DSTc = DSTc * X + SRCc * Y
+ *
+ * and the same for the alpha component with its own formula and
+ * coefficients. Formula 1 selects the alternate blend expression of the
+ * hardware (CBES and ABES bits). The coefficients select a VSP2_BLEND_COEF_*
+ * source, the fixed coefficients X and Y are shared by the color and alpha
+ * components.
+ *
+ * In VSP2_BLEND_MODE_ROP the unit applies the raster operation codes of the
+ * hardware (0 = NOP, 1 = AND, ..., 6 = XOR, ..., 15 = SET) to the color and
+ * alpha components.
+ */
+enum vsp2_blend_param {
+	VSP2_BLEND_MODE,	/* VSP2_BLEND_MODE_* */
+	VSP2_BLEND_FORMULA,	/* color formula, 0 or 1 */
+	VSP2_BLEND_COEFX,	/* color coefficient X, VSP2_BLEND_COEF_* */
+	VSP2_BLEND_COEFY,	/* color coefficient Y, VSP2_BLEND_COEF_* */
+	VSP2_BLEND_AFORMULA,	/* alpha formula, 0 or 1 */
+	VSP2_BLEND_ACOEFX,	/* alpha coefficient X, VSP2_BLEND_COEF_* */
+	VSP2_BLEND_ACOEFY,	/* alpha coefficient Y, VSP2_BLEND_COEF_* */
+	VSP2_BLEND_FIXX,	/* fixed coefficient X, 0 to 255 */
+	VSP2_BLEND_FIXY,	/* fixed coefficient Y, 0 to 255 */
+	VSP2_BLEND_CROP,	/* color raster operation, 0 to 15 */
+	VSP2_BLEND_AROP,	/* alpha raster operation, 0 to 15 */
+	VSP2_BLEND_NUM_PARAMS,
+};
+
+#define VSP2_BLEND_MODE_AUTO	(0)	/* alpha blending (default) */
+#define VSP2_BLEND_MODE_BLEND	(1)	/* formula and coefficients */
+#define VSP2_BLEND_MODE_ROP	(2)	/* raster operation */
+
+#define VSP2_BLEND_COEF_DST_A		(0)	/* DST alpha */
+#define VSP2_BLEND_COEF_DST_A_INV	(1)	/* 255 - DST alpha */
+#define VSP2_BLEND_COEF_SRC_A		(2)	/* SRC alpha */
+#define VSP2_BLEND_COEF_SRC_A_INV	(3)	/* 255 - SRC alpha */
+#define VSP2_BLEND_COEF_FIXED		(4)	/* fixed coefficient */
+
 /*--------------------------------------------------------------------------
  * for debug
  *--------------------------------------------------------------------------
@@ -55,61 +55,413 @@
  * GNU General Public License for more details.
  */ /*************************************************************************/
 
+
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
 #include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "vsp2_device.h"
 #include "vsp2_addr.h"
+#include "vsp2_entity.h"
 
 /* ---------------------------------------------------------------------
- * convert address (user virt. -> kernel virt.)
+ * check address (hard.)
  *----------------------------------------------------------------------
  */
 
-unsigned long vsp2_addr_uv2kv(unsigned long uvaddr)
+/*
+ * vsp2_addr_check - Check that a buffer is addressable by the hardware
+ * @vsp2: the VSP2 device
+ * @addr: device address of the buffer
+ * @size: size of the buffer
+ *
+ * Memory allocated or mapped for the device honours VSP2_DMA_MASK. Buffers
+ * mapped for another device may not, they are refused here instead of having
+ * their address truncated when handed to VSPM.
+ *
+ * Return 0 if the buffer is addressable or -EINVAL otherwise.
+ */
+int vsp2_addr_check(struct vsp2_device *vsp2, dma_addr_t addr, size_t size)
 {
-#ifdef USE_BUFFER	/* TODO: delete USE_BUFFER */
+	u64 end = (u64)addr + (size ? size - 1 : 0);
+
+	if (end > VSP2_DMA_MASK) {
+		dev_err_ratelimited(vsp2->dev,
+				    "buffer %pad out of DMA range\n", &addr);
+		return -EINVAL;
+	}
+
 	return 0;
-#else
+}
+
+/* ---------------------------------------------------------------------
+ * pin user memory (user virt. -> hard. and kernel virt.)
+ *----------------------------------------------------------------------
+ */
+
+static void vsp2_addr_release(struct vsp2_device *vsp2,
+			      struct vsp2_addr_pin *pin)
+{
+	list_del(&pin->list);
+
+	vunmap((void *)((unsigned long)pin->vaddr & PAGE_MASK));
+	dma_unmap_sgtable(vsp2->dev, &pin->sgt, DMA_BIDIRECTIONAL, 0);
+	sg_free_table(&pin->sgt);
+
+	/* The hardware may have written to the memory (histograms). */
+	unpin_user_pages_dirty_lock(pin->pages, pin->nr_pages, true);
+	kvfree(pin->pages);
+	mmdrop(pin->mm);
+	kfree(pin);
+}
+
+static struct vsp2_addr_pin *vsp2_addr_create(struct vsp2_device *vsp2,
+					      unsigned long uvaddr,
+					      size_t size)
+{
+	struct vsp2_addr_pin *pin;
+	unsigned long offset = offset_in_page(uvaddr);
+	struct scatterlist *sg;
+	dma_addr_t next;
+	void *vaddr;
+	unsigned int i;
+	int ret;
+
+	pin = kzalloc(sizeof(*pin), GFP_KERNEL);
+	if (!pin)
+		return ERR_PTR(-ENOMEM);
+
+	pin->uvaddr = uvaddr;
+	pin->size = size;
+	pin->nr_pages = DIV_ROUND_UP(offset + size, PAGE_SIZE);
+
+	pin->pages = kvmalloc_array(pin->nr_pages, sizeof(*pin->pages),
+				    GFP_KERNEL);
+	if (!pin->pages) {
+		ret = -ENOMEM;
+		goto error_free;
+	}
+
+	ret = pin_user_pages_fast(uvaddr & PAGE_MASK, pin->nr_pages,
+				  FOLL_WRITE | FOLL_LONGTERM, pin->pages);
+	if (ret != pin->nr_pages) {
+		if (ret > 0)
+			unpin_user_pages(pin->pages, ret);
+		ret = ret < 0 ? ret : -EFAULT;
+		goto error_free;
+	}
+
+	ret = sg_alloc_table_from_pages(&pin->sgt, pin->pages, pin->nr_pages,
+					offset, size, GFP_KERNEL);
+	if (ret < 0)
+		goto error_unpin;
+
+	ret = dma_map_sgtable(vsp2->dev, &pin->sgt, DMA_BIDIRECTIONAL, 0);
+	if (ret < 0)
+		goto error_sgt;
+
+	/* The VSP2 takes a single base address for each table. */
+	next = sg_dma_address(pin->sgt.sgl);
+	for_each_sg(pin->sgt.sgl, sg, pin->sgt.nents, i) {
+		if (sg_dma_address(sg) != next) {
+			dev_dbg(vsp2->dev, "user memory not contiguous\n");
+			ret = -EINVAL;
+			goto error_unmap;
+		}
+		next += sg_dma_len(sg);
+	}
 
-	struct vm_area_struct	*vma;
-	struct mm_struct		*mm = current->mm;
-	unsigned long			kvaddr;
-	unsigned long			pfn;
-	unsigned long			start;
+	ret = vsp2_addr_check(vsp2, sg_dma_address(pin->sgt.sgl), size);
+	if (ret < 0)
+		goto error_unmap;
 
-	vma     = find_vma(mm, uvaddr);
-	start   = uvaddr & PAGE_MASK;
+	vaddr = vmap(pin->pages, pin->nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!vaddr) {
+		ret = -ENOMEM;
+		goto error_unmap;
+	}
 
-	follow_pfn(vma, start, &pfn);
+	pin->addr = sg_dma_address(pin->sgt.sgl);
+	pin->vaddr = vaddr + offset;
 
-	kvaddr  = (unsigned long)phys_to_virt(pfn << PAGE_SHIFT);
+	mmgrab(current->mm);
+	pin->mm = current->mm;
 
-	return kvaddr;
-#endif
+	return pin;
+
+error_unmap:
+	dma_unmap_sgtable(vsp2->dev, &pin->sgt, DMA_BIDIRECTIONAL, 0);
+error_sgt:
+	sg_free_table(&pin->sgt);
+error_unpin:
+	unpin_user_pages(pin->pages, pin->nr_pages);
+error_free:
+	kvfree(pin->pages);
+	kfree(pin);
+	return ERR_PTR(ret);
+}
+
+/* Must be called with the pin_lock held. */
+static bool vsp2_addr_has_owner(struct vsp2_device *vsp2,
+				struct mm_struct *mm)
+{
+	struct vsp2_addr_owner *owner;
+
+	list_for_each_entry(owner, &vsp2->pin_owners, list) {
+		if (owner->mm == mm)
+			return true;
+	}
+
+	return false;
+}
+
+/* Must be called with the pin_lock held. */
+static unsigned int vsp2_addr_count_registered(struct vsp2_device *vsp2,
+					       struct mm_struct *mm)
+{
+	struct vsp2_addr_pin *pin;
+	unsigned int count = 0;
+
+	list_for_each_entry(pin, &vsp2->pins, list) {
+		if (pin->registered && pin->mm == mm)
+			count++;
+	}
+
+	return count;
+}
+
+/*
+ * vsp2_addr_pin - Pin user memory for device access
+ * @vsp2: the VSP2 device
+ * @uaddr: user address of the memory
+ * @size: size of the memory
+ *
+ * Look the memory up in the pins registered by the current process, pin and
+ * register it on first use. The registration is skipped when the process has
+ * no table subdev open or already has VSP2_ADDR_MAX_PINS registrations, the
+ * memory is then unpinned as soon as the caller releases it. The caller owns
+ * a reference to the pin and must release it with vsp2_addr_unpin().
+ *
+ * Return the pin or an ERR_PTR() on failure.
+ */
+struct vsp2_addr_pin *vsp2_addr_pin(struct vsp2_device *vsp2,
+				    void __user *uaddr, size_t size)
+{
+	unsigned long uvaddr = (unsigned long)uaddr;
+	struct vsp2_addr_pin *pin;
+
+	if (!size || !access_ok(uaddr, size))
+		return ERR_PTR(-EFAULT);
+
+	mutex_lock(&vsp2->pin_lock);
+
+	list_for_each_entry(pin, &vsp2->pins, list) {
+		if (pin->registered && pin->mm == current->mm &&
+		    pin->uvaddr == uvaddr && pin->size >= size) {
+			pin->refcount++;
+			goto done;
+		}
+	}
+
+	pin = vsp2_addr_create(vsp2, uvaddr, size);
+	if (IS_ERR(pin))
+		goto done;
+
+	pin->refcount = 1;
+	list_add_tail(&pin->list, &vsp2->pins);
+
+	if (vsp2_addr_has_owner(vsp2, current->mm) &&
+	    vsp2_addr_count_registered(vsp2, current->mm) <
+	    VSP2_ADDR_MAX_PINS) {
+		pin->refcount++;
+		pin->registered = true;
+	}
+
+done:
+	mutex_unlock(&vsp2->pin_lock);
+	return pin;
+}
+
+/* Take an additional reference to a pin. */
+void vsp2_addr_get(struct vsp2_device *vsp2, struct vsp2_addr_pin *pin)
+{
+	mutex_lock(&vsp2->pin_lock);
+	pin->refcount++;
+	mutex_unlock(&vsp2->pin_lock);
+}
+
+/* Release a reference to a pin, the memory is unpinned with the last one. */
+void vsp2_addr_unpin(struct vsp2_device *vsp2, struct vsp2_addr_pin *pin)
+{
+	mutex_lock(&vsp2->pin_lock);
+	if (--pin->refcount == 0)
+		vsp2_addr_release(vsp2, pin);
+	mutex_unlock(&vsp2->pin_lock);
+}
+
+/*
+ * vsp2_addr_unregister - Drop the pins of a user address
+ * @vsp2: the VSP2 device
+ * @config: user address the memory was registered with
+ *
+ * The memory stays pinned while tables still use it, until they are
+ * replaced.
+ *
+ * Return 0 on success or -ENOENT if the address isn't registered.
+ */
+int vsp2_addr_unregister(struct vsp2_device *vsp2,
+			 struct vsp2_addr_config *config)
+{
+	unsigned long uvaddr = (unsigned long)config->addr;
+	struct vsp2_addr_pin *pin, *_pin;
+	int ret = -ENOENT;
+
+	mutex_lock(&vsp2->pin_lock);
+
+	list_for_each_entry_safe(pin, _pin, &vsp2->pins, list) {
+		if (!pin->registered || pin->mm != current->mm ||
+		    pin->uvaddr != uvaddr)
+			continue;
+
+		pin->registered = false;
+		if (--pin->refcount == 0)
+			vsp2_addr_release(vsp2, pin);
+		ret = 0;
+	}
+
+	mutex_unlock(&vsp2->pin_lock);
+	return ret;
+}
+
+/* Must be called with the pin_lock held. */
+static void vsp2_addr_unregister_mm(struct vsp2_device *vsp2,
+				    struct mm_struct *mm)
+{
+	struct vsp2_addr_pin *pin, *_pin;
+
+	list_for_each_entry_safe(pin, _pin, &vsp2->pins, list) {
+		if (!pin->registered || pin->mm != mm)
+			continue;
+
+		pin->registered = false;
+		if (--pin->refcount == 0)
+			vsp2_addr_release(vsp2, pin);
+	}
+}
+
+/* Drop all registrations, called once the entities have been destroyed. */
+void vsp2_addr_cleanup(struct vsp2_device *vsp2)
+{
+	struct vsp2_addr_owner *owner, *_owner;
+	struct vsp2_addr_pin *pin, *_pin;
+
+	mutex_lock(&vsp2->pin_lock);
+
+	list_for_each_entry_safe(owner, _owner, &vsp2->pin_owners, list) {
+		list_del(&owner->list);
+		mmdrop(owner->mm);
+		kfree(owner);
+	}
+
+	list_for_each_entry_safe(pin, _pin, &vsp2->pins, list) {
+		if (pin->registered) {
+			pin->registered = false;
+			pin->refcount--;
+		}
+
+		if (WARN_ON(pin->refcount))
+			continue;
+
+		vsp2_addr_release(vsp2, pin);
+	}
+
+	mutex_unlock(&vsp2->pin_lock);
 }
 
 /* ---------------------------------------------------------------------
- * convert address (user virt. ->hard.)
+ * registration owners
  *----------------------------------------------------------------------
  */
 
-unsigned long vsp2_addr_uv2hd(unsigned long uvaddr)
+/*
+ * The private ioctls don't receive the file handle, registrations are thus
+ * tracked per process. They are dropped when the process closes its last file
+ * handle on a table subdev, which also happens when it exits. current->mm is
+ * already gone by then, the address space is recorded at open time.
+ */
+static int vsp2_addr_open(struct v4l2_subdev *subdev,
+			  struct v4l2_subdev_fh *fh)
 {
-#ifdef USE_BUFFER	/* TODO: delete USE_BUFFER */
+	struct vsp2_device *vsp2 = to_vsp2_entity(subdev)->vsp2;
+	struct vsp2_addr_owner *owner;
+
+	if (!current->mm)
+		return 0;
+
+	owner = kzalloc(sizeof(*owner), GFP_KERNEL);
+	if (!owner)
+		return -ENOMEM;
+
+	mmgrab(current->mm);
+	owner->mm = current->mm;
+	owner->fh = fh;
+
+	mutex_lock(&vsp2->pin_lock);
+	list_add_tail(&owner->list, &vsp2->pin_owners);
+	mutex_unlock(&vsp2->pin_lock);
+
 	return 0;
-#else
+}
+
+static int vsp2_addr_close(struct v4l2_subdev *subdev,
+			   struct v4l2_subdev_fh *fh)
+{
+	struct vsp2_device *vsp2 = to_vsp2_entity(subdev)->vsp2;
+	struct vsp2_addr_owner *owner;
 
-	struct vm_area_struct	*vma;
-	struct mm_struct		*mm = current->mm;
-	unsigned long			hdaddr;
-	unsigned long			pfn;
-	unsigned long			start;
+	mutex_lock(&vsp2->pin_lock);
 
-	vma     = find_vma(mm, uvaddr);
-	start   = uvaddr & PAGE_MASK;
+	list_for_each_entry(owner, &vsp2->pin_owners, list) {
+		if (owner->fh != fh)
+			continue;
 
-	follow_pfn(vma, start, &pfn);
+		list_del(&owner->list);
+		if (!vsp2_addr_has_owner(vsp2, owner->mm))
+			vsp2_addr_unregister_mm(vsp2, owner->mm);
+		mmdrop(owner->mm);
+		kfree(owner);
+		break;
+	}
 
-	hdaddr  = pfn << PAGE_SHIFT;
+	mutex_unlock(&vsp2->pin_lock);
 
-	return hdaddr;
-#endif
+	return 0;
+}
+
+const struct v4l2_subdev_internal_ops vsp2_addr_internal_ops = {
+	.open = vsp2_addr_open,
+	.close = vsp2_addr_close,
+};
+
+/* ---------------------------------------------------------------------
+ * cache maintenance
+ *----------------------------------------------------------------------
+ */
+
+/* Make the CPU writes to the memory visible to the device. */
+void vsp2_addr_sync_for_device(struct vsp2_device *vsp2,
+			       struct vsp2_addr_pin *pin)
+{
+	dma_sync_sgtable_for_device(vsp2->dev, &pin->sgt, DMA_BIDIRECTIONAL);
+}
+
+/* Make the device writes to the memory visible to the CPU. */
+void vsp2_addr_sync_for_cpu(struct vsp2_device *vsp2,
+			    struct vsp2_addr_pin *pin)
+{
+	dma_sync_sgtable_for_cpu(vsp2->dev, &pin->sgt, DMA_BIDIRECTIONAL);
 }
@@ -55,10 +55,89 @@
  * GNU General Public License for more details.
  */ /*************************************************************************/
 
+
 #ifndef __VSP2_ADDR_H__
 #define __VSP2_ADDR_H__
 
-unsigned long vsp2_addr_uv2kv(unsigned long uvaddr);
-unsigned long vsp2_addr_uv2hd(unsigned long uvaddr);
+#include <linux/dma-mapping.h>
+#include <linux/list.h>
+#include <linux/mm_types.h>
+#include <linux/scatterlist.h>
+#include <linux/types.h>
+#include <linux/vsp2.h>
+
+#include <media/v4l2-subdev.h>
+
+struct vsp2_device;
+
+/* VSPM takes 32-bit device addresses for buffers, tables and display lists. */
+#define VSP2_DMA_MASK		DMA_BIT_MASK(32)
+
+/* Maximum number of registered pins per process. */
+#define VSP2_ADDR_MAX_PINS	(32)
+
+/*
+ * struct vsp2_addr_pin - User memory pinned for device access
+ * @list: entry in the device pin list
+ * @mm: address space of the user memory
+ * @uvaddr: user address the memory was registered with
+ * @size: size of the memory
+ * @pages: the pinned pages
+ * @nr_pages: number of pinned pages
+ * @sgt: scatter table of the pages, mapped for the device
+ * @addr: device address of the memory
+ * @vaddr: kernel address of the memory
+ * @refcount: number of users, the registration included
+ * @registered: the pin is found by vsp2_addr_pin() until unregistered
+ *
+ * User memory is pinned on first use and cached per address until it is
+ * unregistered with VIDIOC_VSP2_ADDR_UNREGISTER, or until the process closes
+ * its last table subdev file handle. The memory must be contiguous in the
+ * device address space.
+ */
+struct vsp2_addr_pin {
+	struct list_head list;
+	struct mm_struct *mm;
+	unsigned long uvaddr;
+	size_t size;
+
+	struct page **pages;
+	unsigned int nr_pages;
+	struct sg_table sgt;
+	dma_addr_t addr;
+	void *vaddr;
+
+	unsigned int refcount;
+	bool registered;
+};
+
+/*
+ * struct vsp2_addr_owner - Table subdev file handle able to register pins
+ * @list: entry in the device owner list
+ * @fh: the subdev file handle
+ * @mm: address space of the process that opened the file handle
+ */
+struct vsp2_addr_owner {
+	struct list_head list;
+	struct v4l2_subdev_fh *fh;
+	struct mm_struct *mm;
+};
+
+extern const struct v4l2_subdev_internal_ops vsp2_addr_internal_ops;
+
+int vsp2_addr_check(struct vsp2_device *vsp2, dma_addr_t addr, size_t size);
+
+struct vsp2_addr_pin *vsp2_addr_pin(struct vsp2_device *vsp2,
+				    void __user *uaddr, size_t size);
+void vsp2_addr_get(struct vsp2_device *vsp2, struct vsp2_addr_pin *pin);
+void vsp2_addr_unpin(struct vsp2_device *vsp2, struct vsp2_addr_pin *pin);
+int vsp2_addr_unregister(struct vsp2_device *vsp2,
+			 struct vsp2_addr_config *config);
+void vsp2_addr_cleanup(struct vsp2_device *vsp2);
+
+void vsp2_addr_sync_for_device(struct vsp2_device *vsp2,
+			       struct vsp2_addr_pin *pin);
+void vsp2_addr_sync_for_cpu(struct vsp2_device *vsp2,
+			    struct vsp2_addr_pin *pin);
 
 #endif /* __VSP2_ADDR_H__ */
@@ -0,0 +1,195 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+#include <linux/kernel.h>
+
+#include "vsp2_blend.h"
+#include "vsp2_regs.h"
+
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+/* Limits of each parameter of a Blend/ROP unit, indexed by parameter. */
+static const u8 blend_param_max[VSP2_BLEND_NUM_PARAMS] = {
+	[VSP2_BLEND_MODE]	= VSP2_BLEND_MODE_ROP,
+	[VSP2_BLEND_FORMULA]	= 1,
+	[VSP2_BLEND_COEFX]	= VSP2_BLEND_COEF_FIXED,
+	[VSP2_BLEND_COEFY]	= VSP2_BLEND_COEF_FIXED,
+	[VSP2_BLEND_AFORMULA]	= 1,
+	[VSP2_BLEND_ACOEFX]	= VSP2_BLEND_COEF_FIXED,
+	[VSP2_BLEND_ACOEFY]	= VSP2_BLEND_COEF_FIXED,
+	[VSP2_BLEND_FIXX]	= 0xff,
+	[VSP2_BLEND_FIXY]	= 0xff,
+	[VSP2_BLEND_CROP]	= VI6_ROP_SET,
+	[VSP2_BLEND_AROP]	= VI6_ROP_SET,
+};
+
+static int blend_try_ctrl(struct v4l2_ctrl *ctrl)
+{
+	const u8 *params = ctrl->p_new.p_u8;
+	unsigned int i;
+
+	for (i = 0; i < ctrl->elems; ++i) {
+		if (params[i] > blend_param_max[i % VSP2_BLEND_NUM_PARAMS])
+			return -ERANGE;
+	}
+
+	return 0;
+}
+
+static int blend_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_blend *blend = ctrl->priv;
+
+	memcpy(blend->params, ctrl->p_new.p_u8, ctrl->elems);
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops blend_ctrl_ops = {
+	.try_ctrl = blend_try_ctrl,
+	.s_ctrl = blend_s_ctrl,
+};
+
+void vsp2_blend_init(struct v4l2_ctrl_handler *hdl, struct vsp2_blend *blend,
+		     unsigned int num_units)
+{
+	struct v4l2_ctrl_config cfg = {
+		.ops = &blend_ctrl_ops,
+		.id = VSP2_CID_BLEND,
+		.name = "Blend Parameters",
+		.type = V4L2_CTRL_TYPE_U8,
+		.min = 0,
+		.max = 0xff,
+		.step = 1,
+		.def = 0,
+		.dims = { num_units, VSP2_BLEND_NUM_PARAMS },
+	};
+
+	memset(blend->params, 0, sizeof(blend->params));
+
+	v4l2_ctrl_new_custom(hdl, &cfg, blend);
+}
+
+/* -----------------------------------------------------------------------------
+ * Blend/ROP Unit Configuration
+ */
+
+/* The VSPM coefficient selectors follow the order of the VI6_BRU_BLD_CCMDX,
+ * CCMDY, ACMDX and ACMDY register fields.
+ */
+static const unsigned char blend_coefx[] = {
+	VSP_COEFFICIENT_BLENDX1, VSP_COEFFICIENT_BLENDX2,
+	VSP_COEFFICIENT_BLENDX3, VSP_COEFFICIENT_BLENDX4,
+	VSP_COEFFICIENT_BLENDX5,
+};
+
+static const unsigned char blend_coefy[] = {
+	VSP_COEFFICIENT_BLENDY1, VSP_COEFFICIENT_BLENDY2,
+	VSP_COEFFICIENT_BLENDY3, VSP_COEFFICIENT_BLENDY4,
+	VSP_COEFFICIENT_BLENDY5,
+};
+
+static const unsigned char blend_acoefx[] = {
+	VSP_COEFFICIENT_ALPHAX1, VSP_COEFFICIENT_ALPHAX2,
+	VSP_COEFFICIENT_ALPHAX3, VSP_COEFFICIENT_ALPHAX4,
+	VSP_COEFFICIENT_ALPHAX5,
+};
+
+static const unsigned char blend_acoefy[] = {
+	VSP_COEFFICIENT_ALPHAY1, VSP_COEFFICIENT_ALPHAY2,
+	VSP_COEFFICIENT_ALPHAY3, VSP_COEFFICIENT_ALPHAY4,
+	VSP_COEFFICIENT_ALPHAY5,
+};
+
+/*
+ * vsp2_blend_configure - Override the parameters of an enabled Blend/ROP unit
+ *
+ * The default alpha blending parameters set by the caller are kept when the
+ * unit is in VSP2_BLEND_MODE_AUTO.
+ */
+void vsp2_blend_configure(const struct vsp2_blend *blend, unsigned int unit,
+			  struct vsp_bld_ctrl_t *ctrl)
+{
+	const u8 *params = blend->params[unit];
+
+	switch (params[VSP2_BLEND_MODE]) {
+	case VSP2_BLEND_MODE_BLEND:
+		ctrl->rbc = 1;
+		ctrl->blend_formula = params[VSP2_BLEND_FORMULA] ?
+				      VSP_FORM_BLEND1 : VSP_FORM_BLEND0;
+		ctrl->blend_coefx = blend_coefx[params[VSP2_BLEND_COEFX]];
+		ctrl->blend_coefy = blend_coefy[params[VSP2_BLEND_COEFY]];
+		ctrl->aformula = params[VSP2_BLEND_AFORMULA] ?
+				 VSP_FORM_ALPHA1 : VSP_FORM_ALPHA0;
+		ctrl->acoefx = blend_acoefx[params[VSP2_BLEND_ACOEFX]];
+		ctrl->acoefy = blend_acoefy[params[VSP2_BLEND_ACOEFY]];
+		ctrl->acoefx_fix = params[VSP2_BLEND_FIXX];
+		ctrl->acoefy_fix = params[VSP2_BLEND_FIXY];
+		break;
+
+	case VSP2_BLEND_MODE_ROP:
+		ctrl->rbc = 0;
+		ctrl->crop = params[VSP2_BLEND_CROP];
+		ctrl->arop = params[VSP2_BLEND_AROP];
+		break;
+
+	default:
+		break;
+	}
+}
@@ -336,10 +336,8 @@ static void brs_configure(struct vsp2_entity *entity,
 	format = vsp2_entity_get_pad_format(&brs->entity, brs->entity.config,
 					    BRS_PAD_SOURCE);
 
-	/* The hardware is extremely flexible but we have no userspace API to
-	 * expose all the parameters, nor is it clear whether we would have use
-	 * cases for all the supported modes. Let's just harcode the parameters
-	 * to sane default values for now.
+	/* The Blend/ROP units default to sane alpha blending parameters that
+	 * userspace can override per sink pad through VSP2_CID_BLEND.
 	 */
 
 	/* Disable dithering and enable color data normalization unless the
@@ -384,8 +382,8 @@ static void brs_configure(struct vsp2_entity *entity,
 		if (brs->inputs[i].rpf) {
 			ctrl |= VI6_BRS_CTRL_RBC;
 
-			premultiplied = brs->inputs[i].rpf->format.flags
-				      & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA;
+			premultiplied =
+				vsp2_rpf_premultiplied(brs->inputs[i].rpf);
 		} else {
 			ctrl |= VI6_BRS_CTRL_CROP(VI6_ROP_NOP)
 			     |  VI6_BRS_CTRL_AROP(VI6_ROP_NOP);
@@ -424,6 +422,10 @@ static void brs_configure(struct vsp2_entity *entity,
 		vsp_brs_ctrl->acoefy = VSP_COEFFICIENT_ALPHAY5;
 		vsp_brs_ctrl->acoefx_fix = 0;    /* Set coefficient x. */
 		vsp_brs_ctrl->acoefy_fix = 0xFF; /* Set coefficient y. */
+
+		/* Apply the parameters set through VSP2_CID_BLEND. */
+		if (brs->inputs[i].rpf)
+			vsp2_blend_configure(&brs->blend, i, vsp_brs_ctrl);
 	}
 }
 
@@ -454,11 +456,12 @@ struct vsp2_brs *vsp2_brs_create(struct vsp2_device *vsp2)
 		return ERR_PTR(ret);
 
 	/* Initialize the control handler. */
-	v4l2_ctrl_handler_init(&brs->ctrls, 1);
+	v4l2_ctrl_handler_init(&brs->ctrls, 2);
 	v4l2_ctrl_new_std(&brs->ctrls, &brs_ctrl_ops, V4L2_CID_BG_COLOR,
 			  0, 0xffffff, 1, 0);
 
 	brs->bgcolor = 0;
+	vsp2_blend_init(&brs->ctrls, &brs->blend, BRS_PAD_SOURCE);
 
 	brs->entity.subdev.ctrl_handler = &brs->ctrls;
 
@@ -62,6 +62,7 @@
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 
+#include "vsp2_blend.h"
 #include "vsp2_entity.h"
 
 struct vsp2_device;
@@ -81,6 +82,7 @@ struct vsp2_brs {
 	} inputs[BRS_PAD_SOURCE];
 
 	u32 bgcolor;
+	struct vsp2_blend blend;
 };
 
 static inline struct vsp2_brs *to_brs(struct v4l2_subdev *subdev)
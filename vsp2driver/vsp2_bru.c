@@ -62,6 +62,7 @@
 
 #include "vsp2_device.h"
 #include "vsp2_bru.h"
+#include "vsp2_compose.h"
 #include "vsp2_pipe.h"
 #include "vsp2_rwpf.h"
 #include "vsp2_video.h"
@@ -92,6 +93,23 @@ static const struct v4l2_ctrl_ops bru_ctrl_ops = {
 	.s_ctrl = bru_s_ctrl,
 };
 
+/* -----------------------------------------------------------------------------
+ * V4L2 Subdevice Core Operations
+ */
+
+static long bru_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
+{
+	struct vsp2_bru *bru = to_bru(subdev);
+
+	switch (cmd) {
+	case VIDIOC_VSP2_BRU_COMPOSE:
+		return vsp2_compose_run(bru->entity.vsp2, arg);
+
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
 /* -----------------------------------------------------------------------------
  * V4L2 Subdevice Pad Operations
  */
@@ -303,6 +321,10 @@ done:
  * V4L2 Subdevice Operations
  */
 
+static const struct v4l2_subdev_core_ops bru_core_ops = {
+	.ioctl = bru_ioctl,
+};
+
 static const struct v4l2_subdev_pad_ops bru_pad_ops = {
 	.init_cfg = vsp2_entity_init_cfg,
 	.enum_mbus_code = bru_enum_mbus_code,
@@ -314,6 +336,7 @@ static const struct v4l2_subdev_pad_ops bru_pad_ops = {
 };
 
 static const struct v4l2_subdev_ops bru_ops = {
+	.core	= &bru_core_ops,
 	.pad    = &bru_pad_ops,
 };
 
@@ -336,10 +359,8 @@ static void bru_configure(struct vsp2_entity *entity,
 	format = vsp2_entity_get_pad_format(&bru->entity, bru->entity.config,
 					    BRU_PAD_SOURCE);
 
-	/* The hardware is extremely flexible but we have no userspace API to
-	 * expose all the parameters, nor is it clear whether we would have use
-	 * cases for all the supported modes. Let's just harcode the parameters
-	 * to sane default values for now.
+	/* The Blend/ROP units default to sane alpha blending parameters that
+	 * userspace can override per sink pad through VSP2_CID_BLEND.
 	 */
 
 	/* Disable dithering and enable color data normalization unless the
@@ -401,8 +422,8 @@ static void bru_configure(struct vsp2_entity *entity,
 		if (bru->inputs[i].rpf) {
 			ctrl |= VI6_BRU_CTRL_RBC;
 
-			premultiplied = bru->inputs[i].rpf->format.flags
-				      & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA;
+			premultiplied =
+				vsp2_rpf_premultiplied(bru->inputs[i].rpf);
 		} else {
 			ctrl |= VI6_BRU_CTRL_CROP(VI6_ROP_NOP)
 			     |  VI6_BRU_CTRL_AROP(VI6_ROP_NOP);
@@ -447,6 +468,10 @@ static void bru_configure(struct vsp2_entity *entity,
 		vsp_bru_ctrl->acoefy = VSP_COEFFICIENT_ALPHAY5;
 		vsp_bru_ctrl->acoefx_fix = 0;    /* Set coefficient x. */
 		vsp_bru_ctrl->acoefy_fix = 0xFF; /* Set coefficient y. */
+
+		/* Apply the parameters set through VSP2_CID_BLEND. */
+		if (bru->inputs[i].rpf)
+			vsp2_blend_configure(&bru->blend, i, vsp_bru_ctrl);
 	}
 }
 
@@ -477,11 +502,12 @@ struct vsp2_bru *vsp2_bru_create(struct vsp2_device *vsp2)
 		return ERR_PTR(ret);
 
 	/* Initialize the control handler. */
-	v4l2_ctrl_handler_init(&bru->ctrls, 1);
+	v4l2_ctrl_handler_init(&bru->ctrls, 2);
 	v4l2_ctrl_new_std(&bru->ctrls, &bru_ctrl_ops, V4L2_CID_BG_COLOR,
 			  0, 0xffffff, 1, 0);
 
 	bru->bgcolor = 0;
+	vsp2_blend_init(&bru->ctrls, &bru->blend, BRU_PAD_SOURCE);
 
 	bru->entity.subdev.ctrl_handler = &bru->ctrls;
 
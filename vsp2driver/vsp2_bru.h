@@ -62,6 +62,7 @@
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 
+#include "vsp2_blend.h"
 #include "vsp2_entity.h"
 
 struct vsp2_device;
@@ -85,6 +86,7 @@ struct vsp2_bru {
 	} inputs[BRU_PAD_SOURCE];
 
 	u32 bgcolor;
+	struct vsp2_blend blend;
 };
 
 static inline struct vsp2_bru *to_bru(struct v4l2_subdev *subdev)
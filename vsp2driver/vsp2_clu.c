@@ -56,6 +56,7 @@
  */ /*************************************************************************/
 
 #include <linux/device.h>
+#include <linux/dma-mapping.h>
 #include <linux/gfp.h>
 
 #include <media/v4l2-subdev.h>
@@ -65,20 +66,178 @@
 #include "vsp2_vspm.h"
 #include "vsp2_addr.h"
 
-#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
-#include <linux/dma-mapping.h>	/* for dl_par */
-#endif
-
 #define CLU_MIN_SIZE	(1U)
 #define CLU_MAX_SIZE	(8190U)
 
+#define CLU_MAX_TBL_NUM	(9826U)
+
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+static int clu_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_clu *clu =
+		container_of(ctrl->handler, struct vsp2_clu, ctrls);
+
+	switch (ctrl->id) {
+	case VSP2_CID_CLU_BANK:
+		if (ctrl->val >= 0 && !clu->banks[ctrl->val].virt_addr)
+			return -EINVAL;
+
+		WRITE_ONCE(clu->bank, ctrl->val);
+		break;
+	}
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops clu_ctrl_ops = {
+	.s_ctrl = clu_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config clu_bank_ctrl = {
+	.ops = &clu_ctrl_ops,
+	.id = VSP2_CID_CLU_BANK,
+	.name = "Table Bank",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = -1,
+	.max = VSP2_CLU_NUM_BANKS - 1,
+	.step = 1,
+	.def = -1,
+};
+
 /* -----------------------------------------------------------------------------
  * V4L2 Subdevice Core Operations
  */
 
-static void clu_set_config(struct vsp2_clu *clu, struct vsp2_clu_config *config)
+static int clu_set_config(struct vsp2_clu *clu, struct vsp2_clu_config *config)
 {
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	struct vsp2_addr_pin *pin;
+
+	/* The table in use can't be released while streaming. */
+	if ((clu->dmabuf.dbuf || clu->pin) && clu->entity.subdev.entity.pipe)
+		return -EBUSY;
+
+	pin = vsp2_addr_pin(clu->entity.vsp2, (void __user *)config->addr,
+			    config->tbl_num * 8);
+	if (IS_ERR(pin))
+		return PTR_ERR(pin);
+
+	vsp2_addr_sync_for_device(clu->entity.vsp2, pin);
+
+	if (clu->pin)
+		vsp2_addr_unpin(clu->entity.vsp2, clu->pin);
+	clu->pin = pin;
+#else
+	/* The table in use can't be released while streaming. */
+	if (clu->dmabuf.dbuf && clu->entity.subdev.entity.pipe)
+		return -EBUSY;
+#endif
+
+	vsp2_dmabuf_unmap(&clu->dmabuf);
 	memcpy(&clu->config, config, sizeof(struct vsp2_clu_config));
+
+	return 0;
+}
+
+static int clu_set_dmabuf(struct vsp2_clu *clu,
+			  struct vsp2_clu_dmabuf_config *config)
+{
+	int ret;
+
+	if (!config->tbl_num || config->tbl_num > CLU_MAX_TBL_NUM)
+		return -EINVAL;
+
+	if (clu->entity.subdev.entity.pipe)
+		return -EBUSY;
+
+	vsp2_dmabuf_unmap(&clu->dmabuf);
+
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (clu->pin) {
+		vsp2_addr_unpin(clu->entity.vsp2, clu->pin);
+		clu->pin = NULL;
+	}
+#endif
+
+	ret = vsp2_dmabuf_map(clu->entity.vsp2, config->fd, config->offset,
+			      config->tbl_num * 8, &clu->dmabuf);
+	if (ret < 0)
+		return ret;
+
+	ret = vsp2_dmabuf_vmap(&clu->dmabuf);
+	if (ret < 0) {
+		vsp2_dmabuf_unmap(&clu->dmabuf);
+		return ret;
+	}
+
+	clu->config.mode = config->mode;
+	clu->config.addr = NULL;
+	clu->config.fxa = config->fxa;
+	clu->config.tbl_num = config->tbl_num;
+
+	return 0;
+}
+
+/*
+ * Banks are loaded once and then selected with VSP2_CID_CLU_BANK, the memory
+ * of each bank is allocated on first load. Loading is refused while streaming
+ * as the hardware may be reading any of the banks. The graph mutex is held
+ * for the whole load so that streaming can't start before it completes.
+ */
+static int clu_load_bank(struct vsp2_clu *clu,
+			 struct vsp2_clu_bank_config *config)
+{
+	struct media_device *mdev = &clu->entity.vsp2->media_dev;
+	struct vsp2_clu_table *bank;
+	dma_addr_t hard_addr;
+	void *virt_addr;
+	int ret = 0;
+
+	if (config->bank >= VSP2_CLU_NUM_BANKS || !config->config.tbl_num ||
+	    config->config.tbl_num > CLU_MAX_TBL_NUM)
+		return -EINVAL;
+
+	/* Serialize with pipeline start and the bank selection control. */
+	mutex_lock(&mdev->graph_mutex);
+	mutex_lock(clu->ctrls.lock);
+
+	if (clu->entity.subdev.entity.pipe) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	bank = &clu->banks[config->bank];
+	if (!bank->virt_addr) {
+		virt_addr = dma_alloc_coherent(clu->entity.vsp2->dev,
+					       CLU_MAX_TBL_NUM * 8, &hard_addr,
+					       GFP_KERNEL);
+		if (!virt_addr) {
+			ret = -ENOMEM;
+			goto done;
+		}
+
+		bank->virt_addr = virt_addr;
+		bank->hard_addr = hard_addr;
+	}
+
+	if (copy_from_user(bank->virt_addr,
+			   (void __user *)config->config.addr,
+			   config->config.tbl_num * 8)) {
+		ret = -EFAULT;
+		goto done;
+	}
+
+	bank->mode = config->config.mode;
+	bank->tbl_num = config->config.tbl_num;
+	bank->fxa = config->config.fxa;
+
+done:
+	mutex_unlock(clu->ctrls.lock);
+	mutex_unlock(&mdev->graph_mutex);
+	return ret;
 }
 
 static long clu_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
@@ -87,8 +246,16 @@ static long clu_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
 
 	switch (cmd) {
 	case VIDIOC_VSP2_CLU_CONFIG:
-		clu_set_config(clu, arg);
-		return 0;
+		return clu_set_config(clu, arg);
+
+	case VIDIOC_VSP2_CLU_DMABUF:
+		return clu_set_dmabuf(clu, arg);
+
+	case VIDIOC_VSP2_CLU_BANK_LOAD:
+		return clu_load_bank(clu, arg);
+
+	case VIDIOC_VSP2_ADDR_UNREGISTER:
+		return vsp2_addr_unregister(clu->entity.vsp2, arg);
 
 	default:
 		return -ENOIOCTLCMD;
@@ -141,6 +308,7 @@ static int clu_set_format(
 
 	/* Default to YUV if the requested format is not supported. */
 	if (fmt->format.code != MEDIA_BUS_FMT_ARGB8888_1X32 &&
+	    fmt->format.code != MEDIA_BUS_FMT_AHSV8888_1X32 &&
 	    fmt->format.code != MEDIA_BUS_FMT_AYUV8_1X32)
 		fmt->format.code = MEDIA_BUS_FMT_AYUV8_1X32;
 
@@ -207,16 +375,43 @@ static struct vsp_start_t *to_vsp_par(struct vsp2_entity *entity)
 	return entity->vsp2->vspm->ip_par.par.vsp;
 }
 
-static void clu_configure(struct vsp2_entity *entity,
-			  struct vsp2_pipeline *pipe)
+static void clu_set_table(struct vsp2_clu *clu,
+			  const struct vsp2_clu_table *table)
 {
-	struct vsp2_clu     *clu     = to_clu(&entity->subdev);
 	struct vsp_start_t  *vsp_par = to_vsp_par(&clu->entity);
 	struct vsp_clu_t    *vsp_clu = vsp_par->ctrl_par->clu;
 
 	/* VSPM parameter */
 
-	vsp_clu->mode           = clu->config.mode;
+	vsp_clu->mode           = table->mode;
+	vsp_clu->clu.hard_addr  = (unsigned int)table->hard_addr;
+	vsp_clu->clu.virt_addr  = table->virt_addr;
+	vsp_clu->clu.tbl_num    = table->tbl_num;
+	vsp_clu->fxa            = table->fxa;
+	/*vsp_clu->connect      = 0;  set by vsp2_entity_route_setup() */
+}
+
+static const struct vsp2_clu_table *clu_get_table(struct vsp2_clu *clu,
+						  int bank)
+{
+	return bank < 0 ? &clu->base : &clu->banks[bank];
+}
+
+static void clu_configure(struct vsp2_entity *entity,
+			  struct vsp2_pipeline *pipe)
+{
+	struct vsp2_clu       *clu  = to_clu(&entity->subdev);
+	struct vsp2_clu_table *base = &clu->base;
+
+	base->mode      = clu->config.mode;
+	base->tbl_num   = clu->config.tbl_num;
+	base->fxa       = clu->config.fxa;
+
+	if (clu->dmabuf.dbuf) {
+		base->hard_addr = clu->dmabuf.addr;
+		base->virt_addr = clu->dmabuf.vaddr;
+		goto done;
+	}
 
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 
@@ -229,21 +424,63 @@ static void clu_configure(struct vsp2_entity *entity,
 			   clu->config.tbl_num * 8))
 		VSP2_PRINT_ALERT("%s() error<2>!!", __func__);
 
-	vsp_clu->clu.hard_addr  = (unsigned int)clu->buff_h;
-	vsp_clu->clu.virt_addr	= (void *)clu->buff_v;
+	base->hard_addr = clu->buff_h;
+	base->virt_addr = (void *)clu->buff_v;
 #else
-	vsp_clu->clu.hard_addr  =
-		(unsigned int)vsp2_addr_uv2hd((unsigned long)clu->config.addr);
+	if (clu->pin) {
+		base->hard_addr = clu->pin->addr;
+		base->virt_addr = clu->pin->vaddr;
+	}
+#endif
+
+done:
+	clu->cur_bank = READ_ONCE(clu->bank);
+	clu_set_table(clu, clu_get_table(clu, clu->cur_bank));
+}
+
+/*
+ * vsp2_clu_prepare - Select the table used by the next job
+ * @clu: the CLU
+ *
+ * Switch to the table selected by VSP2_CID_CLU_BANK if it changed since the
+ * previous job. Must be called with the pipeline irqlock held, right before
+ * the job is handed to VSPM.
+ */
+void vsp2_clu_prepare(struct vsp2_clu *clu)
+{
+	int bank = READ_ONCE(clu->bank);
+
+	if (bank == clu->cur_bank)
+		return;
+
+	clu->cur_bank = bank;
+	clu_set_table(clu, clu_get_table(clu, bank));
+}
 
-	vsp_clu->clu.virt_addr  =
-		(void *)vsp2_addr_uv2kv((unsigned long)clu->config.addr);
+static void clu_destroy(struct vsp2_entity *entity)
+{
+	struct vsp2_clu *clu = to_clu(&entity->subdev);
+	struct vsp2_clu_table *bank;
+	unsigned int i;
+
+	vsp2_dmabuf_unmap(&clu->dmabuf);
+
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (clu->pin)
+		vsp2_addr_unpin(clu->entity.vsp2, clu->pin);
 #endif
-	vsp_clu->clu.tbl_num    = clu->config.tbl_num;
-	vsp_clu->fxa            = clu->config.fxa;
-	/*vsp_clu->connect      = 0;  set by vsp2_entity_route_setup() */
+
+	for (i = 0; i < VSP2_CLU_NUM_BANKS; ++i) {
+		bank = &clu->banks[i];
+		if (bank->virt_addr)
+			dma_free_coherent(clu->entity.vsp2->dev,
+					  CLU_MAX_TBL_NUM * 8,
+					  bank->virt_addr, bank->hard_addr);
+	}
 }
 
 static const struct vsp2_entity_operations clu_entity_ops = {
+	.destroy = clu_destroy,
 	.configure = clu_configure,
 };
 
@@ -268,11 +505,28 @@ struct vsp2_clu *vsp2_clu_create(struct vsp2_device *vsp2)
 	if (ret < 0)
 		return ERR_PTR(ret);
 
+	clu->entity.subdev.internal_ops = &vsp2_addr_internal_ops;
+
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	clu->buff_v = dma_alloc_coherent(vsp2->dev,
 					 CLU_BUFF_SIZE, &clu->buff_h,
-					 GFP_KERNEL | GFP_DMA);
+					 GFP_KERNEL);
 #endif
 
+	/* Initialize the control handler. */
+	v4l2_ctrl_handler_init(&clu->ctrls, 1);
+	v4l2_ctrl_new_custom(&clu->ctrls, &clu_bank_ctrl, NULL);
+
+	clu->bank = -1;
+
+	clu->entity.subdev.ctrl_handler = &clu->ctrls;
+
+	if (clu->ctrls.error) {
+		dev_err(vsp2->dev, "clu: failed to initialize controls\n");
+		ret = clu->ctrls.error;
+		vsp2_entity_destroy(&clu->entity);
+		return ERR_PTR(ret);
+	}
+
 	return clu;
 }
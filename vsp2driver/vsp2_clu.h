@@ -59,9 +59,12 @@
 #define __VSP2_CLU_H__
 
 #include <media/media-entity.h>
+#include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 #include <linux/vsp2.h>
 
+#include "vsp2_addr.h"
+#include "vsp2_dmabuf.h"
 #include "vsp2_entity.h"
 
 struct vsp2_device;
@@ -73,17 +76,44 @@ struct vsp2_device;
 #define	CLU_BUFF_SIZE			(9826 * 8)
 #endif
 
+/*
+ * struct vsp2_clu_table - Table handed to VSPM
+ * @hard_addr: device address of the table
+ * @virt_addr: kernel address of the table, NULL for an unloaded bank
+ * @mode: table mode, one of VSP_CLU_MODE_*
+ * @tbl_num: number of table entries
+ * @fxa: fixed alpha value
+ */
+struct vsp2_clu_table {
+	dma_addr_t	hard_addr;
+	void		*virt_addr;
+	unsigned char	mode;
+	unsigned short	tbl_num;
+	unsigned char	fxa;
+};
+
 struct vsp2_clu {
 	/* entitiy */
 	struct vsp2_entity		entity;
 
 	/* config */
 	struct vsp2_clu_config	config;
+	struct vsp2_dmabuf		dmabuf;
+
+	/* tables */
+	struct v4l2_ctrl_handler	ctrls;
+	struct vsp2_clu_table	base;
+	struct vsp2_clu_table	banks[VSP2_CLU_NUM_BANKS];
+	int				bank;
+	int				cur_bank;
 
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	/* buffer */
 	void					*buff_v;
 	dma_addr_t				buff_h;
+#else
+	/* pinned user memory */
+	struct vsp2_addr_pin	*pin;
 #endif
 };
 
@@ -93,5 +123,6 @@ static inline struct vsp2_clu *to_clu(struct v4l2_subdev *subdev)
 }
 
 struct vsp2_clu *vsp2_clu_create(struct vsp2_device *vsp2);
+void vsp2_clu_prepare(struct vsp2_clu *clu);
 
 #endif /* __VSP2_CLU_H__ */
@@ -0,0 +1,481 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/slab.h>
+
+#include "vsp2_device.h"
+#include "vsp2_bru.h"
+#include "vsp2_compose.h"
+#include "vsp2_dmabuf.h"
+#include "vsp2_pipe.h"
+#include "vsp2_vspm.h"
+
+#define COMPOSE_FOURCC		V4L2_PIX_FMT_ARGB32
+#define COMPOSE_BPP		(4)
+#define COMPOSE_MAX_SIZE	(8190U)
+
+/* -----------------------------------------------------------------------------
+ * Buffers
+ */
+
+static int vsp2_compose_check_buffer(const struct vsp2_compose_buffer *buf)
+{
+	if (!buf->width || !buf->height ||
+	    buf->width > COMPOSE_MAX_SIZE || buf->height > COMPOSE_MAX_SIZE)
+		return -EINVAL;
+
+	if (buf->stride < buf->width * COMPOSE_BPP)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int vsp2_compose_map(struct vsp2_device *vsp2,
+			    const struct vsp2_compose_buffer *buf,
+			    struct vsp2_dmabuf *map)
+{
+	size_t size;
+
+	size = (size_t)buf->stride * (buf->height - 1)
+	     + buf->width * COMPOSE_BPP;
+
+	return vsp2_dmabuf_map(vsp2, buf->fd, buf->offset, size, map);
+}
+
+static void vsp2_compose_free_pool(struct vsp2_device *vsp2)
+{
+	struct vsp2_compose *compose = vsp2->compose;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(compose->pool_v); i++) {
+		if (!compose->pool_v[i])
+			continue;
+
+		dma_free_coherent(vsp2->dev, compose->pool_size,
+				  compose->pool_v[i], compose->pool_h[i]);
+		compose->pool_v[i] = NULL;
+	}
+
+	compose->pool_size = 0;
+}
+
+/*
+ * The intermediate buffers are kept from one composition to the next and only
+ * reallocated when a larger destination is composed.
+ */
+static int vsp2_compose_alloc_pool(struct vsp2_device *vsp2, size_t size)
+{
+	struct vsp2_compose *compose = vsp2->compose;
+	unsigned int i;
+
+	if (size <= compose->pool_size)
+		return 0;
+
+	vsp2_compose_free_pool(vsp2);
+
+	for (i = 0; i < ARRAY_SIZE(compose->pool_v); i++) {
+		compose->pool_v[i] = dma_alloc_coherent(vsp2->dev, size,
+							&compose->pool_h[i],
+							GFP_KERNEL);
+		if (!compose->pool_v[i]) {
+			compose->pool_size = size;
+			vsp2_compose_free_pool(vsp2);
+			return -ENOMEM;
+		}
+	}
+
+	compose->pool_size = size;
+
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+ * VSPM Parameters
+ */
+
+static struct vsp_start_t *vsp2_compose_init_par(struct vsp2_compose *compose)
+{
+	struct vsp2_vspm_job_par *par = &compose->par;
+	struct vsp_start_t *vsp_par = &par->start;
+	unsigned int i;
+
+	memset(par, 0, sizeof(*par));
+
+	for (i = 0; i < 5; i++) {
+		vsp_par->src_par[i] = &par->src[i];
+		par->src[i].alpha = &par->alpha[i];
+		par->alpha[i].mult = &par->mult[i];
+	}
+
+	vsp_par->dst_par = &par->dst;
+	par->dst.fcp = &par->fcp;
+
+	vsp_par->ctrl_par = &par->ctrl;
+	par->ctrl.bru = &par->bru;
+	par->bru.blend_virtual = &par->bru_virtual;
+	par->bru.blend_unit_a = &par->bru_blend[0];
+	par->bru.blend_unit_b = &par->bru_blend[1];
+	par->bru.blend_unit_c = &par->bru_blend[2];
+	par->bru.blend_unit_d = &par->bru_blend[3];
+	par->bru.blend_unit_e = &par->bru_blend[4];
+
+	vsp_par->use_module = VSP_BRU_USE;
+
+	return vsp_par;
+}
+
+static void vsp2_compose_set_src(struct vsp_start_t *vsp_par,
+				 dma_addr_t addr, unsigned int stride,
+				 unsigned int width, unsigned int height,
+				 unsigned int left, unsigned int top,
+				 unsigned int alpha)
+{
+	const struct vsp2_format_info *fmtinfo =
+		vsp2_get_format_info(COMPOSE_FOURCC);
+	struct vsp_src_t *vsp_in = vsp_par->src_par[vsp_par->rpf_num];
+
+	vsp_in->addr		= (unsigned int)addr;
+	vsp_in->stride		= stride;
+	vsp_in->width		= width;
+	vsp_in->height		= height;
+	vsp_in->format		= (fmtinfo->hwfmt << VI6_RPF_INFMT_RDFMT_SHIFT)
+				| ((fmtinfo->bpp[0] / 8) << 8);
+	vsp_in->cipm		= 1;
+	vsp_in->swap		= fmtinfo->swap;
+	vsp_in->x_position	= left;
+	vsp_in->y_position	= top;
+	vsp_in->pwd		= VSP_LAYER_CHILD;
+	vsp_in->vir		= VSP_NO_VIR;
+	vsp_in->connect		= VSP_BRU_USE;
+
+	/* Use the pixel alpha, scaled by the layer alpha. */
+	vsp_in->alpha->swap	= VSP_SWAP_NO;
+	vsp_in->alpha->aext	= 1;
+	vsp_in->alpha->mult->a_mmd = VSP_MULT_RATIO;
+	vsp_in->alpha->mult->p_mmd = VSP_MULT_THROUGH;
+	vsp_in->alpha->mult->ratio = alpha;
+
+	vsp_par->rpf_num++;
+}
+
+static void vsp2_compose_set_dst(struct vsp_start_t *vsp_par,
+				 dma_addr_t addr, unsigned int stride,
+				 unsigned int width, unsigned int height)
+{
+	const struct vsp2_format_info *fmtinfo =
+		vsp2_get_format_info(COMPOSE_FOURCC);
+	struct vsp_dst_t *vsp_out = vsp_par->dst_par;
+
+	vsp_out->addr		= (unsigned int)addr;
+	vsp_out->stride		= stride;
+	vsp_out->width		= width;
+	vsp_out->height		= height;
+	vsp_out->format		= (fmtinfo->hwfmt << VI6_WPF_OUTFMT_WRFMT_SHIFT)
+				| ((fmtinfo->bpp[0] / 8) << 8);
+	vsp_out->swap		= fmtinfo->swap;
+	vsp_out->pxa		= 1;
+	vsp_out->pad		= 0xff;
+	vsp_out->cbrm		= VSP_CSC_ROUND_DOWN;
+	vsp_out->abrm		= VSP_CONVERSION_ROUNDDOWN;
+	vsp_out->clmd		= VSP_CLMD_NO;
+	vsp_out->rotation	= VSP_ROT_OFF;
+	vsp_out->fcp->fcnl	= FCP_FCNL_DISABLE;
+}
+
+static void vsp2_compose_set_bru(struct vsp_start_t *vsp_par,
+				 unsigned int width, unsigned int height,
+				 u32 bgcolor)
+{
+	struct vsp_bru_t *vsp_bru = vsp_par->ctrl_par->bru;
+	struct vsp_bld_ctrl_t *units[] = {
+		vsp_bru->blend_unit_a, vsp_bru->blend_unit_b,
+		vsp_bru->blend_unit_c, vsp_bru->blend_unit_d,
+		vsp_bru->blend_unit_e,
+	};
+	unsigned int i;
+
+	vsp_bru->adiv = (VI6_BRU_INCTRL_NRM & (1 << 28)) >> 28;
+
+	vsp_bru->blend_virtual->width		= width;
+	vsp_bru->blend_virtual->height		= height;
+	vsp_bru->blend_virtual->pwd		= VSP_LAYER_PARENT;
+	vsp_bru->blend_virtual->color =
+		(bgcolor & 0xffffff) | (0xff << VI6_BRU_VIRRPF_COL_A_SHIFT);
+
+	/* Same blending as the BRU entity for non-premultiplied inputs, unused
+	 * Blend/ROP units pass their DST input through.
+	 */
+	for (i = 0; i < ARRAY_SIZE(units); i++) {
+		struct vsp_bld_ctrl_t *vsp_bru_ctrl = units[i];
+
+		if (i < vsp_par->rpf_num) {
+			vsp_bru_ctrl->rbc = 1;
+		} else {
+			vsp_bru_ctrl->crop = VI6_ROP_NOP;
+			vsp_bru_ctrl->arop = VI6_ROP_NOP;
+		}
+
+		vsp_bru_ctrl->blend_formula = VSP_FORM_BLEND0;
+		vsp_bru_ctrl->blend_coefx = VSP_COEFFICIENT_BLENDX4;
+		vsp_bru_ctrl->blend_coefy = VSP_COEFFICIENT_BLENDY3;
+		vsp_bru_ctrl->aformula = VSP_FORM_ALPHA0;
+		vsp_bru_ctrl->acoefx = VSP_COEFFICIENT_ALPHAX4;
+		vsp_bru_ctrl->acoefy = VSP_COEFFICIENT_ALPHAY5;
+		vsp_bru_ctrl->acoefx_fix = 0;
+		vsp_bru_ctrl->acoefy_fix = 0xFF;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+ * Composition
+ */
+
+static int vsp2_compose_check(struct vsp2_compose_config *config)
+{
+	const struct vsp2_compose_buffer *dst = &config->dst;
+	unsigned int i;
+
+	if (!config->num_layers ||
+	    config->num_layers > VSP2_COMPOSE_MAX_LAYERS)
+		return -EINVAL;
+
+	if (vsp2_compose_check_buffer(dst) < 0)
+		return -EINVAL;
+
+	for (i = 0; i < config->num_layers; i++) {
+		const struct vsp2_compose_layer *layer = &config->layers[i];
+
+		if (vsp2_compose_check_buffer(&layer->buf) < 0)
+			return -EINVAL;
+
+		if (layer->left + layer->buf.width > dst->width ||
+		    layer->top + layer->buf.height > dst->height)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * vsp2_compose_run - Blend a list of layers into a destination buffer
+ * @vsp2: the VSP2 device
+ * @config: the composition
+ *
+ * The BRU blends at most one layer per RPF in a single job. Layers are thus
+ * blended in passes, the first pass blends the bottom layers over the
+ * background color and each following pass blends the next layers over the
+ * result of the previous one, read back through RPF0. Intermediate results
+ * are written to the pool buffers, the last pass writes to the destination.
+ */
+long vsp2_compose_run(struct vsp2_device *vsp2,
+		      struct vsp2_compose_config *config)
+{
+	struct vsp2_compose *compose = vsp2->compose;
+	struct media_device *mdev = &vsp2->media_dev;
+	struct vsp2_dmabuf maps[VSP2_COMPOSE_MAX_LAYERS];
+	struct vsp2_dmabuf dst_map;
+	const struct vsp2_compose_buffer *dst = &config->dst;
+	unsigned int max_inputs;
+	unsigned int tmp_stride;
+	unsigned int first = 0;
+	unsigned int pass = 0;
+	unsigned int i;
+	long ret;
+
+	ret = vsp2_compose_check(config);
+	if (ret < 0)
+		return ret;
+
+	/* Each pass after the first one reads the previous result back through
+	 * one of the inputs, at least two are needed to make progress.
+	 */
+	max_inputs = min_t(unsigned int, vsp2->pdata.rpf_count, BRU_PAD_SOURCE);
+	if (config->num_layers > max_inputs && max_inputs < 2)
+		return -EINVAL;
+
+	tmp_stride = dst->width * COMPOSE_BPP;
+
+	/* Claim the BRU against streaming pipelines, STREAMON checks the busy
+	 * flag under the same lock.
+	 */
+	mutex_lock(&mdev->graph_mutex);
+	if (vsp2->bru->entity.subdev.entity.pipe || compose->busy) {
+		mutex_unlock(&mdev->graph_mutex);
+		return -EBUSY;
+	}
+	compose->busy = true;
+	mutex_unlock(&mdev->graph_mutex);
+
+	memset(maps, 0, sizeof(maps));
+	memset(&dst_map, 0, sizeof(dst_map));
+
+	mutex_lock(&compose->lock);
+
+	for (i = 0; i < config->num_layers; i++) {
+		ret = vsp2_compose_map(vsp2, &config->layers[i].buf, &maps[i]);
+		if (ret < 0)
+			goto done;
+	}
+
+	ret = vsp2_compose_map(vsp2, dst, &dst_map);
+	if (ret < 0)
+		goto done;
+
+	if (config->num_layers > max_inputs) {
+		ret = vsp2_compose_alloc_pool(vsp2,
+					      (size_t)tmp_stride * dst->height);
+		if (ret < 0)
+			goto done;
+	}
+
+	ret = vsp2_device_get(vsp2);
+	if (ret < 0)
+		goto done;
+
+	while (first < config->num_layers) {
+		struct vsp_start_t *vsp_par = vsp2_compose_init_par(compose);
+		unsigned int count = max_inputs;
+		bool last;
+
+		/* Feed the previous result back as the bottom layer. */
+		if (pass) {
+			vsp2_compose_set_src(vsp_par,
+					     compose->pool_h[!(pass & 1)],
+					     tmp_stride, dst->width,
+					     dst->height, 0, 0, 255);
+			count--;
+		}
+
+		count = min(count, config->num_layers - first);
+		last = first + count == config->num_layers;
+
+		for (i = first; i < first + count; i++) {
+			const struct vsp2_compose_layer *layer =
+				&config->layers[i];
+
+			vsp2_compose_set_src(vsp_par, maps[i].addr,
+					     layer->buf.stride,
+					     layer->buf.width,
+					     layer->buf.height,
+					     layer->left, layer->top,
+					     layer->alpha);
+		}
+
+		if (last)
+			vsp2_compose_set_dst(vsp_par, dst_map.addr,
+					     dst->stride, dst->width,
+					     dst->height);
+		else
+			vsp2_compose_set_dst(vsp_par,
+					     compose->pool_h[pass & 1],
+					     tmp_stride, dst->width,
+					     dst->height);
+
+		vsp2_compose_set_bru(vsp_par, dst->width, dst->height,
+				     config->bgcolor);
+
+		ret = vsp2_vspm_job_run(vsp2, vsp_par);
+		if (ret < 0) {
+			dev_err(vsp2->dev, "compose: pass %u failed\n", pass);
+			break;
+		}
+
+		first += count;
+		pass++;
+	}
+
+	vsp2_device_put(vsp2);
+
+done:
+	vsp2_dmabuf_unmap(&dst_map);
+	for (i = 0; i < config->num_layers; i++)
+		vsp2_dmabuf_unmap(&maps[i]);
+
+	mutex_unlock(&compose->lock);
+
+	mutex_lock(&mdev->graph_mutex);
+	compose->busy = false;
+	mutex_unlock(&mdev->graph_mutex);
+
+	return ret;
+}
+
+/* -----------------------------------------------------------------------------
+ * Initialization and Cleanup
+ */
+
+int vsp2_compose_init(struct vsp2_device *vsp2)
+{
+	vsp2->compose = devm_kzalloc(vsp2->dev, sizeof(*vsp2->compose),
+				     GFP_KERNEL);
+	if (!vsp2->compose)
+		return -ENOMEM;
+
+	mutex_init(&vsp2->compose->lock);
+
+	return 0;
+}
+
+void vsp2_compose_cleanup(struct vsp2_device *vsp2)
+{
+	if (!vsp2->compose)
+		return;
+
+	vsp2_compose_free_pool(vsp2);
+}
@@ -0,0 +1,96 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+#ifndef __VSP2_COMPOSE_H__
+#define __VSP2_COMPOSE_H__
+
+#include <linux/mutex.h>
+#include <linux/types.h>
+#include <linux/vsp2.h>
+
+#include "vsp2_vspm.h"
+
+struct vsp2_device;
+
+/*
+ * struct vsp2_compose - Multi-pass composition state
+ * @lock: serializes compositions
+ * @busy: a composition uses the BRU, protected by the media graph_mutex
+ * @par: VSPM parameters of the pass being prepared
+ * @pool_size: size of each intermediate buffer
+ * @pool_v: CPU addresses of the intermediate buffers
+ * @pool_h: device addresses of the intermediate buffers
+ *
+ * Intermediate results alternate between the two pool buffers, so that each
+ * pass reads the result of the previous one while writing to the other.
+ */
+struct vsp2_compose {
+	struct mutex lock;	/* serializes compositions */
+	bool busy;
+	struct vsp2_vspm_job_par par;
+
+	size_t pool_size;
+	void *pool_v[2];
+	dma_addr_t pool_h[2];
+};
+
+int vsp2_compose_init(struct vsp2_device *vsp2);
+void vsp2_compose_cleanup(struct vsp2_device *vsp2);
+long vsp2_compose_run(struct vsp2_device *vsp2,
+		      struct vsp2_compose_config *config);
+
+#endif /* __VSP2_COMPOSE_H__ */
@@ -95,6 +95,10 @@ const char *vsp2_debug_get_entity_name(struct vsp2_entity *pentity)
 		{ VSP2_ENTITY_HGO, "VSP2_ENTITY_HGO"},
 		{ VSP2_ENTITY_HGT, "VSP2_ENTITY_HGT"},
 		{ VSP2_ENTITY_WPF, "VSP2_ENTITY_WPF"},
+		{ VSP2_ENTITY_SRU, "VSP2_ENTITY_SRU"},
+		{ VSP2_ENTITY_SHP, "VSP2_ENTITY_SHP"},
+		{ VSP2_ENTITY_HST, "VSP2_ENTITY_HST"},
+		{ VSP2_ENTITY_HSI, "VSP2_ENTITY_HSI"},
 	};
 
 	/* search */
@@ -58,9 +58,11 @@
 #ifndef __VSP2_DEVICE_H__
 #define __VSP2_DEVICE_H__
 
+#include <linux/atomic.h>
 #include <linux/io.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include <media/media-device.h>
 #include <media/v4l2-device.h>
@@ -76,12 +78,16 @@ struct device;
 struct vsp2_entity;
 struct vsp2_bru;
 struct vsp2_rwpf;
+struct vsp2_shp;
+struct vsp2_sru;
 struct vsp2_uds;
 struct vsp2_lut;
 struct vsp2_hgo;
 struct vsp2_hgt;
+struct vsp2_hsit;
 struct vsp2_vspm;
 struct vsp2_brs;
+struct vsp2_compose;
 
 #define DEVNAME			"vsp2"
 #define DRVNAME			DEVNAME
@@ -94,18 +100,23 @@ struct vsp2_brs;
 #define VSP2_COUNT_RPF	(4)
 #define VSP2_COUNT_UDS	(1)
 #define VSP2_COUNT_WPF	(1)
+#define VSP2_COUNT_CH	(1)
 
 #define VSP2_HAS_BRU		(1 << 0)
 #define VSP2_HAS_LUT		(1 << 1)
 #define VSP2_HAS_CLU		(1 << 2)
 #define VSP2_HAS_HGO		(1 << 3)
 #define VSP2_HAS_HGT		(1 << 4)
+#define VSP2_HAS_SRU		(1 << 6)
+#define VSP2_HAS_SHP		(1 << 7)
+#define VSP2_HAS_HSIT		(1 << 8)
 
 #else
 
 #define VSP2_COUNT_RPF	(5)
 #define VSP2_COUNT_UDS	(1)
 #define VSP2_COUNT_WPF	(1)
+#define VSP2_COUNT_CH	(5)
 
 #define VSP2_HAS_BRU		(1 << 0)
 #define VSP2_HAS_LUT		(1 << 1)
@@ -113,6 +124,9 @@ struct vsp2_brs;
 #define VSP2_HAS_HGO		(1 << 3)
 #define VSP2_HAS_HGT		(1 << 4)
 #define VSP2_HAS_BRS		(1 << 5)
+#define VSP2_HAS_SRU		(1 << 6)
+#define VSP2_HAS_SHP		(1 << 7)
+#define VSP2_HAS_HSIT		(1 << 8)
 
 #endif
 
@@ -121,7 +135,8 @@ struct vsp2_platform_data {
 	unsigned int rpf_count;
 	unsigned int uds_count;
 	unsigned int wpf_count;
-	unsigned int use_ch;
+	unsigned int ch_count;
+	unsigned int use_ch[VSP2_COUNT_CH];
 };
 
 struct vsp2_device {
@@ -131,12 +146,20 @@ struct vsp2_device {
 	struct mutex		lock;	/* Protects the reference count */
 	int					ref_count;
 
+	bool				vspm_active;	/* VSPM handle is open */
+	struct delayed_work	idle_work;		/* Deferred VSPM release */
+	atomic64_t			open_ns;		/* First open, for latency */
+
 	struct vsp2_bru		*bru;
 	struct vsp2_lut		*lut;
 	struct vsp2_clu		*clu;
 	struct vsp2_hgo		*hgo;
 	struct vsp2_hgt		*hgt;
 	struct vsp2_brs		*brs;
+	struct vsp2_sru		*sru;
+	struct vsp2_shp		*shp;
+	struct vsp2_hsit	*hst;
+	struct vsp2_hsit	*hsi;
 	struct vsp2_rwpf	*rpf[VSP2_COUNT_RPF];
 	struct vsp2_uds		*uds[VSP2_COUNT_UDS];
 	struct vsp2_rwpf	*wpf[VSP2_COUNT_WPF];
@@ -150,6 +173,11 @@ struct vsp2_device {
 	struct media_entity_operations media_ops;
 
 	struct vsp2_vspm	*vspm;
+	struct vsp2_compose	*compose;
+
+	struct mutex		pin_lock;	/* Protects the pin lists */
+	struct list_head	pins;			/* Pinned user memory */
+	struct list_head	pin_owners;	/* Table subdev file handles */
 };
 
 void	vsp2_frame_end(struct vsp2_device *vsp2);
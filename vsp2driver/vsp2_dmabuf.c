@@ -0,0 +1,179 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+
+#include <linux/device.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
+
+#include "vsp2_device.h"
+#include "vsp2_dmabuf.h"
+#include "vsp2_addr.h"
+
+/*
+ * vsp2_dmabuf_map - Import a dmabuf for device access
+ * @vsp2: the VSP2 device
+ * @fd: dmabuf file descriptor
+ * @offset: offset of the data in the dmabuf
+ * @size: size of the data
+ * @map: the mapping to fill
+ *
+ * The VSP2 takes a single base address for each buffer, the dmabuf must thus
+ * be contiguous in the device address space.
+ *
+ * Return 0 on success or a negative error code otherwise.
+ */
+int vsp2_dmabuf_map(struct vsp2_device *vsp2, int fd, unsigned int offset,
+		    size_t size, struct vsp2_dmabuf *map)
+{
+	struct scatterlist *sg;
+	dma_addr_t next;
+	unsigned int i;
+	int ret;
+
+	map->vaddr = NULL;
+	map->dbuf = dma_buf_get(fd);
+	if (IS_ERR(map->dbuf)) {
+		ret = PTR_ERR(map->dbuf);
+		map->dbuf = NULL;
+		return ret;
+	}
+
+	if ((size_t)offset + size > map->dbuf->size) {
+		ret = -EINVAL;
+		goto error_put;
+	}
+
+	map->attach = dma_buf_attach(map->dbuf, vsp2->dev);
+	if (IS_ERR(map->attach)) {
+		ret = PTR_ERR(map->attach);
+		goto error_put;
+	}
+
+	map->sgt = dma_buf_map_attachment(map->attach, DMA_BIDIRECTIONAL);
+	if (IS_ERR(map->sgt)) {
+		ret = PTR_ERR(map->sgt);
+		goto error_detach;
+	}
+
+	next = sg_dma_address(map->sgt->sgl);
+	for_each_sg(map->sgt->sgl, sg, map->sgt->nents, i) {
+		if (sg_dma_address(sg) != next) {
+			dev_dbg(vsp2->dev, "dmabuf not contiguous\n");
+			ret = -EINVAL;
+			goto error_unmap;
+		}
+		next += sg_dma_len(sg);
+	}
+
+	ret = vsp2_addr_check(vsp2, sg_dma_address(map->sgt->sgl) + offset,
+			      size);
+	if (ret < 0)
+		goto error_unmap;
+
+	map->offset = offset;
+	map->addr = sg_dma_address(map->sgt->sgl) + offset;
+
+	return 0;
+
+error_unmap:
+	dma_buf_unmap_attachment(map->attach, map->sgt, DMA_BIDIRECTIONAL);
+error_detach:
+	dma_buf_detach(map->dbuf, map->attach);
+error_put:
+	dma_buf_put(map->dbuf);
+	map->dbuf = NULL;
+	return ret;
+}
+
+/*
+ * vsp2_dmabuf_vmap - Map an imported dmabuf in the kernel address space
+ * @map: the mapping
+ *
+ * VSPM reads tables through their kernel address to build its display lists,
+ * in addition to the device address.
+ *
+ * Return 0 on success or a negative error code otherwise.
+ */
+int vsp2_dmabuf_vmap(struct vsp2_dmabuf *map)
+{
+	void *vaddr;
+
+	vaddr = dma_buf_vmap(map->dbuf);
+	if (!vaddr)
+		return -ENOMEM;
+
+	map->vaddr = vaddr + map->offset;
+
+	return 0;
+}
+
+void vsp2_dmabuf_unmap(struct vsp2_dmabuf *map)
+{
+	if (!map->dbuf)
+		return;
+
+	if (map->vaddr)
+		dma_buf_vunmap(map->dbuf, map->vaddr - map->offset);
+
+	dma_buf_unmap_attachment(map->attach, map->sgt, DMA_BIDIRECTIONAL);
+	dma_buf_detach(map->dbuf, map->attach);
+	dma_buf_put(map->dbuf);
+	map->dbuf = NULL;
+	map->vaddr = NULL;
+}
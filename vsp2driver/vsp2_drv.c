@@ -57,7 +57,9 @@
 
 #include <linux/delay.h>
 #include <linux/device.h>
+#include <linux/dma-mapping.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
@@ -68,17 +70,32 @@
 #include "vsp2_device.h"
 #include "vsp2_bru.h"
 #include "vsp2_brs.h"
+#include "vsp2_compose.h"
 #include "vsp2_lut.h"
 #include "vsp2_clu.h"
 #include "vsp2_pipe.h"
 #include "vsp2_rwpf.h"
+#include "vsp2_shp.h"
+#include "vsp2_sru.h"
 #include "vsp2_uds.h"
 #include "vsp2_video.h"
 #include "vsp2_hgo.h"
 #include "vsp2_hgt.h"
+#include "vsp2_hsit.h"
 #include "vsp2_vspm.h"
+#include "vsp2_addr.h"
 #include "vsp2_debug.h"
 
+/*
+ * Time in milliseconds the VSPM handle is kept open after the last close.
+ * Reopening the device within that period reuses the handle and skips the
+ * VSPM initialization. 0 releases the handle immediately on the last close.
+ */
+static unsigned int vspm_idle_timeout;
+module_param(vspm_idle_timeout, uint, 0644);
+MODULE_PARM_DESC(vspm_idle_timeout,
+		 "VSPM handle idle timeout in milliseconds (default: 0)");
+
 /* -----------------------------------------------------------------------------
  * frame end proccess
  */
@@ -86,6 +103,12 @@
 void vsp2_frame_end(struct vsp2_device *vsp2)
 {
 	unsigned int i;
+	u64 open_ns = atomic64_xchg(&vsp2->open_ns, 0);
+
+	if (open_ns) {
+		dev_dbg(vsp2->dev, "open to first frame latency : %llu us\n",
+			div_u64(ktime_get_ns() - open_ns, NSEC_PER_USEC));
+	}
 
 	/* pipeline flame end */
 
@@ -191,6 +214,30 @@ static int vsp2_create_links(struct vsp2_device *vsp2)
 			return ret;
 	}
 
+	if (vsp2->hgo) {
+		struct vsp2_hgo *hgo = vsp2->hgo;
+
+		ret = media_create_pad_link(&hgo->entity.subdev.entity,
+					    hgo->entity.source_pad,
+					    &hgo->histo.video.entity, 0,
+					    MEDIA_LNK_FL_ENABLED |
+					    MEDIA_LNK_FL_IMMUTABLE);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (vsp2->hgt) {
+		struct vsp2_hgt *hgt = vsp2->hgt;
+
+		ret = media_create_pad_link(&hgt->entity.subdev.entity,
+					    hgt->entity.source_pad,
+					    &hgt->histo.video.entity, 0,
+					    MEDIA_LNK_FL_ENABLED |
+					    MEDIA_LNK_FL_IMMUTABLE);
+		if (ret < 0)
+			return ret;
+	}
+
 	for (i = 0; i < vsp2->pdata.wpf_count; ++i) {
 		/* Connect the video device to the WPF. All connections are
 		 * immutable except for the WPF0 source link.
@@ -214,11 +261,15 @@ static int vsp2_create_links(struct vsp2_device *vsp2)
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 static void vsp2_free_buffers(struct vsp2_device *vsp2)
 {
-	if (vsp2->lut && vsp2->lut->buff_v)
-		dma_free_coherent(vsp2->dev,
-				  LUT_BUFF_SIZE,
-				  vsp2->lut->buff_v,
-				  vsp2->lut->buff_h);
+	unsigned int i;
+
+	for (i = 0; vsp2->lut && i < LUT_NUM_SLOTS; ++i) {
+		if (vsp2->lut->buff_v[i])
+			dma_free_coherent(vsp2->dev,
+					  LUT_BUFF_SIZE,
+					  vsp2->lut->buff_v[i],
+					  vsp2->lut->buff_h[i]);
+	}
 
 	if (vsp2->clu && vsp2->clu->buff_v)
 		dma_free_coherent(vsp2->dev,
@@ -340,6 +391,46 @@ static int vsp2_create_entities(struct vsp2_device *vsp2)
 		list_add_tail(&vsp2->clu->entity.list_dev, &vsp2->entities);
 	}
 
+	/* - SRU */
+
+	if (vsp2->pdata.features & VSP2_HAS_SRU) {
+		vsp2->sru = vsp2_sru_create(vsp2);
+		if (IS_ERR(vsp2->sru)) {
+			ret = PTR_ERR(vsp2->sru);
+			goto done;
+		}
+		list_add_tail(&vsp2->sru->entity.list_dev, &vsp2->entities);
+	}
+
+	/* - SHP */
+
+	if (vsp2->pdata.features & VSP2_HAS_SHP) {
+		vsp2->shp = vsp2_shp_create(vsp2);
+		if (IS_ERR(vsp2->shp)) {
+			ret = PTR_ERR(vsp2->shp);
+			goto done;
+		}
+		list_add_tail(&vsp2->shp->entity.list_dev, &vsp2->entities);
+	}
+
+	/* - HST and HSI */
+
+	if (vsp2->pdata.features & VSP2_HAS_HSIT) {
+		vsp2->hst = vsp2_hsit_create(vsp2, false);
+		if (IS_ERR(vsp2->hst)) {
+			ret = PTR_ERR(vsp2->hst);
+			goto done;
+		}
+		list_add_tail(&vsp2->hst->entity.list_dev, &vsp2->entities);
+
+		vsp2->hsi = vsp2_hsit_create(vsp2, true);
+		if (IS_ERR(vsp2->hsi)) {
+			ret = PTR_ERR(vsp2->hsi);
+			goto done;
+		}
+		list_add_tail(&vsp2->hsi->entity.list_dev, &vsp2->entities);
+	}
+
 	/* - HGO */
 
 	if (vsp2->pdata.features & VSP2_HAS_HGO) {
@@ -467,11 +558,43 @@ static int vsp2_device_init(struct vsp2_device *vsp2)
 	return 0;
 }
 
+static void vsp2_device_quit(struct vsp2_device *vsp2)
+{
+	long vspm_ret = R_VSPM_OK;
+
+	if (!vsp2->vspm_active)
+		return;
+
+	vspm_ret = vsp2_vspm_drv_quit(vsp2);
+	if (vspm_ret != R_VSPM_OK)
+		dev_err(vsp2->dev,
+			"failed to exit the VSPM driver : %ld\n",
+			vspm_ret);
+
+	vsp2->vspm_active = false;
+}
+
+static void vsp2_device_idle_work(struct work_struct *work)
+{
+	struct vsp2_device *vsp2 =
+		container_of(to_delayed_work(work), struct vsp2_device,
+			     idle_work);
+
+	mutex_lock(&vsp2->lock);
+
+	/* The device might have been reopened while the work was pending. */
+	if (vsp2->ref_count == 0)
+		vsp2_device_quit(vsp2);
+
+	mutex_unlock(&vsp2->lock);
+}
+
 /*
  * vsp2_device_get - Acquire the VSP2 device
  *
  * Increment the VSP2 reference count and initialize the device if the first
- * reference is taken.
+ * reference is taken. A VSPM handle still kept open by a previous user is
+ * reused as is.
  *
  * Return 0 on success or a negative error code otherwise.
  */
@@ -483,10 +606,18 @@ int vsp2_device_get(struct vsp2_device *vsp2)
 	if (vsp2->ref_count > 0)
 		goto done;
 
+	cancel_delayed_work(&vsp2->idle_work);
+	atomic64_set(&vsp2->open_ns, ktime_get_ns());
+
+	if (vsp2->vspm_active)
+		goto done;
+
 	ret = vsp2_device_init(vsp2);
 	if (ret < 0)
 		goto done;
 
+	vsp2->vspm_active = true;
+
 done:
 	if (!ret)
 		vsp2->ref_count++;
@@ -498,24 +629,25 @@ done:
 /*
  * vsp2_device_put - Release the VSP2 device
  *
- * Decrement the VSP2 reference count and cleanup the device if the last
- * reference is released.
+ * Decrement the VSP2 reference count. When the last reference is released the
+ * VSPM handle is kept open for vspm_idle_timeout milliseconds before the device
+ * is cleaned up, so that back-to-back users don't pay for its initialization.
  */
 void vsp2_device_put(struct vsp2_device *vsp2)
 {
-	long vspm_ret = R_VSPM_OK;
-
 	if (vsp2->ref_count == 0)
 		return;
 
 	mutex_lock(&vsp2->lock);
 
 	if (--vsp2->ref_count == 0) {
-		vspm_ret = vsp2_vspm_drv_quit(vsp2);
-		if (vspm_ret != R_VSPM_OK)
-			dev_err(vsp2->dev,
-				"failed to exit the VSPM driver : %ld\n",
-				vspm_ret);
+		atomic64_set(&vsp2->open_ns, 0);
+
+		if (vspm_idle_timeout)
+			schedule_delayed_work(&vsp2->idle_work,
+				msecs_to_jiffies(vspm_idle_timeout));
+		else
+			vsp2_device_quit(vsp2);
 	}
 
 	mutex_unlock(&vsp2->lock);
@@ -531,8 +663,15 @@ static int __maybe_unused vsp2_pm_suspend(struct device *dev)
 
 	WARN_ON(mutex_is_locked(&vsp2->lock));
 
-	if (vsp2->ref_count == 0)
+	if (vsp2->ref_count == 0) {
+		/* Release a VSPM handle kept open by the idle period. */
+		cancel_delayed_work_sync(&vsp2->idle_work);
+		mutex_lock(&vsp2->lock);
+		if (vsp2->ref_count == 0)
+			vsp2_device_quit(vsp2);
+		mutex_unlock(&vsp2->lock);
 		return 0;
+	}
 
 	vsp2_pipelines_suspend(vsp2);
 
@@ -561,11 +700,38 @@ static const struct dev_pm_ops vsp2_pm_ops = {
  * Platform Driver
  */
 
+static int vsp2_parse_ch(unsigned int ch, unsigned int *use_ch)
+{
+	switch (ch) {
+	case 0:
+		*use_ch = VSPM_USE_CH0;
+		break;
+	case 1:
+		*use_ch = VSPM_USE_CH1;
+		break;
+	case 2:
+		*use_ch = VSPM_USE_CH2;
+		break;
+	case 3:
+		*use_ch = VSPM_USE_CH3;
+		break;
+	case 4:
+		*use_ch = VSPM_USE_CH4;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int vsp2_parse_dt(struct vsp2_device *vsp2)
 {
 	struct device_node			*np = vsp2->dev->of_node;
 	struct vsp2_platform_data	*pdata = &vsp2->pdata;
 	unsigned int ch;
+	int count;
+	int i;
 
 	if (of_property_read_bool(np, "renesas,has-bru"))
 		pdata->features |= VSP2_HAS_BRU;
@@ -579,6 +745,15 @@ static int vsp2_parse_dt(struct vsp2_device *vsp2)
 	if (of_property_read_bool(np, "renesas,has-clu"))
 		pdata->features |= VSP2_HAS_CLU;
 
+	if (of_property_read_bool(np, "renesas,has-sru"))
+		pdata->features |= VSP2_HAS_SRU;
+
+	if (of_property_read_bool(np, "renesas,has-shp"))
+		pdata->features |= VSP2_HAS_SHP;
+
+	if (of_property_read_bool(np, "renesas,has-hsit"))
+		pdata->features |= VSP2_HAS_HSIT;
+
 	if (of_property_read_bool(np, "renesas,has-hgo"))
 		pdata->features |= VSP2_HAS_HGO;
 
@@ -607,28 +782,27 @@ static int vsp2_parse_dt(struct vsp2_device *vsp2)
 		return -EINVAL;
 	}
 
-	if (of_property_read_u32(np, "renesas,#ch", &ch) == 0) {
-		switch (ch) {
-		case 0:
-			pdata->use_ch = VSPM_USE_CH0;
-			break;
-		case 1:
-			pdata->use_ch = VSPM_USE_CH1;
-			break;
-		case 2:
-			pdata->use_ch = VSPM_USE_CH2;
-			break;
-		case 3:
-			pdata->use_ch = VSPM_USE_CH3;
-			break;
-		case 4:
-			pdata->use_ch = VSPM_USE_CH4;
-			break;
-		default:
+	count = of_property_count_u32_elems(np, "renesas,#ch");
+	if (count > 0) {
+		if (count > VSP2_COUNT_CH) {
+			dev_err(vsp2->dev, "invalid number of channels (%d)\n",
+				count);
 			return -EINVAL;
 		}
+
+		for (i = 0; i < count; i++) {
+			of_property_read_u32_index(np, "renesas,#ch", i, &ch);
+			if (vsp2_parse_ch(ch, &pdata->use_ch[i]) < 0) {
+				dev_err(vsp2->dev, "invalid channel (%u)\n",
+					ch);
+				return -EINVAL;
+			}
+		}
+
+		pdata->ch_count = count;
 	} else {
-		pdata->use_ch = VSPM_EMPTY_CH;
+		pdata->use_ch[0] = VSPM_EMPTY_CH;
+		pdata->ch_count = 1;
 	}
 
 	return 0;
@@ -645,19 +819,53 @@ static int vsp2_probe(struct platform_device *pdev)
 
 	vsp2->dev = &pdev->dev;
 	mutex_init(&vsp2->lock);
+	INIT_DELAYED_WORK(&vsp2->idle_work, vsp2_device_idle_work);
 	INIT_LIST_HEAD(&vsp2->entities);
 	INIT_LIST_HEAD(&vsp2->videos);
+	mutex_init(&vsp2->pin_lock);
+	INIT_LIST_HEAD(&vsp2->pins);
+	INIT_LIST_HEAD(&vsp2->pin_owners);
 
 	ret = vsp2_parse_dt(vsp2);
 	if (ret < 0)
 		return ret;
 
+	/* VSPM takes 32-bit device addresses. Behind an IOMMU the memory
+	 * itself can be anywhere.
+	 */
+	ret = dma_set_mask_and_coherent(vsp2->dev, VSP2_DMA_MASK);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "failed to set the DMA mask\n");
+		return ret;
+	}
+
+	/* Behind the IPMMU buffers only need to be contiguous in the device
+	 * address space. Let the IOMMU map them as a single segment, buffers
+	 * are then allocated from any pages and non-contiguous dmabufs can be
+	 * imported. Without IOMMU they must be physically contiguous (CMA).
+	 */
+	if (device_iommu_mapped(vsp2->dev)) {
+		ret = dma_set_max_seg_size(vsp2->dev, UINT_MAX);
+		if (ret < 0) {
+			dev_err(&pdev->dev, "failed to set DMA segment size\n");
+			return ret;
+		}
+	} else {
+		dev_info(&pdev->dev, "no IOMMU, using contiguous buffers\n");
+	}
+
 	ret = vsp2_vspm_init(vsp2, pdev->id);
 	if (ret < 0) {
 		dev_err(&pdev->dev, "failed to initialize VSPM info\n");
 		return ret;
 	}
 
+	ret = vsp2_compose_init(vsp2);
+	if (ret < 0) {
+		vsp2_vspm_exit(vsp2);
+		return ret;
+	}
+
 	/* Instanciate entities */
 	ret = vsp2_create_entities(vsp2);
 	if (ret < 0) {
@@ -675,7 +883,16 @@ static int vsp2_remove(struct platform_device *pdev)
 	struct vsp2_device *vsp2 = platform_get_drvdata(pdev);
 
 	vsp2_device_put(vsp2);
+
+	cancel_delayed_work_sync(&vsp2->idle_work);
+	mutex_lock(&vsp2->lock);
+	vsp2_device_quit(vsp2);
+	mutex_unlock(&vsp2->lock);
+
 	vsp2_destroy_entities(vsp2);
+	vsp2_addr_cleanup(vsp2);
+
+	vsp2_compose_cleanup(vsp2);
 
 	/* Finalize VSPM */
 
@@ -91,6 +91,22 @@ void vsp2_entity_route_setup(struct vsp2_entity *source)
 		vsp_start->use_module |= VSP_UDS_USE;
 		connect = VSP_UDS_USE;
 		break;
+	case VSP2_ENTITY_SRU:
+		vsp_start->use_module |= VSP_SRU_USE;
+		connect = VSP_SRU_USE;
+		break;
+	case VSP2_ENTITY_SHP:
+		vsp_start->use_module |= VSP_SHP_USE;
+		connect = VSP_SHP_USE;
+		break;
+	case VSP2_ENTITY_HST:
+		vsp_start->use_module |= VSP_HST_USE;
+		connect = VSP_HST_USE;
+		break;
+	case VSP2_ENTITY_HSI:
+		vsp_start->use_module |= VSP_HSI_USE;
+		connect = VSP_HSI_USE;
+		break;
 	case VSP2_ENTITY_BRU:
 		vsp_start->use_module |= VSP_BRU_USE;
 		connect = VSP_BRU_USE;
@@ -129,6 +145,18 @@ void vsp2_entity_route_setup(struct vsp2_entity *source)
 	case VSP2_ENTITY_UDS:
 		vsp_start->ctrl_par->uds->connect = connect;
 		break;
+	case VSP2_ENTITY_SRU:
+		vsp_start->ctrl_par->sru->connect = connect;
+		break;
+	case VSP2_ENTITY_SHP:
+		vsp_start->ctrl_par->shp->connect = connect;
+		break;
+	case VSP2_ENTITY_HST:
+		vsp_start->ctrl_par->hst->connect = connect;
+		break;
+	case VSP2_ENTITY_HSI:
+		vsp_start->ctrl_par->hsi->connect = connect;
+		break;
 	case VSP2_ENTITY_LUT:
 		vsp_start->ctrl_par->lut->connect = connect;
 		break;
@@ -439,6 +467,10 @@ static const struct vsp2_route vsp2_routes[] = {
 #else
 	{ VSP2_ENTITY_RPF, 4 },
 #endif
+	{ VSP2_ENTITY_SRU, 0 },
+	{ VSP2_ENTITY_SHP, 0 },
+	{ VSP2_ENTITY_HST, 0 },
+	{ VSP2_ENTITY_HSI, 0 },
 	{ VSP2_ENTITY_UDS, 0 },
 	{ VSP2_ENTITY_BRS, 0 },
 	{ VSP2_ENTITY_WPF, 0 },
@@ -76,6 +76,10 @@ enum vsp2_entity_type {
 	VSP2_ENTITY_HGT,
 	VSP2_ENTITY_WPF,
 	VSP2_ENTITY_BRS,
+	VSP2_ENTITY_SRU,
+	VSP2_ENTITY_SHP,
+	VSP2_ENTITY_HST,
+	VSP2_ENTITY_HSI,
 };
 
 /**
@@ -63,6 +63,7 @@
 
 #include "vsp2_device.h"
 #include "vsp2_hgo.h"
+#include "vsp2_pipe.h"
 #include "vsp2_vspm.h"
 #include "vsp2_addr.h"
 
@@ -74,11 +75,25 @@
  * V4L2 Subdevice Core Operations
  */
 
-static void hgo_set_config(struct vsp2_hgo *hgo, struct vsp2_hgo_config *config)
+static int hgo_set_config(struct vsp2_hgo *hgo, struct vsp2_hgo_config *config)
 {
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	struct vsp2_addr_pin *pin;
+
+	pin = vsp2_addr_pin(hgo->entity.vsp2, config->addr, HGO_BUFF_SIZE);
+	if (IS_ERR(pin))
+		return PTR_ERR(pin);
+
+	if (hgo->pin)
+		vsp2_addr_unpin(hgo->entity.vsp2, hgo->pin);
+	hgo->pin = pin;
+#endif
+
 	hgo->set_hgo = 1;/* set HGT parameter from user */
 
 	memcpy(&hgo->config, config, sizeof(struct vsp2_hgo_config));
+
+	return 0;
 }
 
 static long hgo_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
@@ -87,8 +102,10 @@ static long hgo_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
 
 	switch (cmd) {
 	case VIDIOC_VSP2_HGO_CONFIG:
-		hgo_set_config(hgo, arg);
-		return 0;
+		return hgo_set_config(hgo, arg);
+
+	case VIDIOC_VSP2_ADDR_UNREGISTER:
+		return vsp2_addr_unregister(hgo->entity.vsp2, arg);
 
 	default:
 		return -ENOIOCTLCMD;
@@ -126,6 +143,8 @@ static void hgo_configure(struct vsp2_entity *entity,
 		hgo->entity.vsp2->vspm->ip_par.par.vsp;
 	struct vsp_hgo_t *vsp_hgo = vsp_par->ctrl_par->hgo;
 
+	hgo->enabled = hgo->set_hgo == 1;
+
 	if (hgo->set_hgo == 1) {
 		/* VSPM parameter */
 
@@ -143,13 +162,22 @@ static void hgo_configure(struct vsp2_entity *entity,
 		vsp_hgo->hard_addr = (unsigned int)hgo->buff_h;
 	#endif
 #else
+		/* The stream keeps its memory pinned until the next one. */
+		if (hgo->pin)
+			vsp2_addr_get(hgo->entity.vsp2, hgo->pin);
+		if (hgo->active_pin)
+			vsp2_addr_unpin(hgo->entity.vsp2, hgo->active_pin);
+		hgo->active_pin = hgo->pin;
+
+		if (!hgo->active_pin) {
+			VSP2_PRINT_ALERT("%s() error!!", __func__);
+			return;
+		}
 	#ifdef TYPE_GEN2
-		vsp_hgo->addr = (void *)vsp2_addr_uv2hd(
-			(unsigned long)hgo->config.addr);
+		vsp_hgo->addr = (void *)(unsigned long)hgo->active_pin->addr;
 	#else
 		vsp_hgo->virt_addr = NULL;
-		vsp_hgo->hard_addr = (unsigned int)vsp2_addr_uv2hd(
-			(unsigned long)hgo->config.addr);
+		vsp_hgo->hard_addr = (unsigned int)hgo->active_pin->addr;
 	#endif
 #endif
 		vsp_hgo->width			= hgo->config.width;
@@ -165,7 +193,99 @@ static void hgo_configure(struct vsp2_entity *entity,
 	}
 }
 
+/*
+ * vsp2_hgo_prepare - Hand the next histogram buffer to a job
+ * @hgo: the HGO
+ * @pipe: the pipeline the job runs on
+ *
+ * When the histogram video node is streaming, the HGO writes the histogram of
+ * each job straight to the next queued buffer. Jobs for which no buffer is
+ * queued, and split jobs, run without the HGO. Must be called with the
+ * pipeline irqlock held, right before the job is handed to VSPM.
+ */
+void vsp2_hgo_prepare(struct vsp2_hgo *hgo, struct vsp2_pipeline *pipe)
+{
+	struct vsp_start_t *vsp_par =
+		hgo->entity.vsp2->vspm->ip_par.par.vsp;
+	struct vsp_hgo_t *vsp_hgo = vsp_par->ctrl_par->hgo;
+	struct vsp2_histogram_buffer *buf;
+
+	if (hgo->set_hgo != 1 || !vsp2_histogram_streaming(&hgo->histo))
+		return;
+
+	/* The halves of a split frame would overwrite each other's
+	 * histogram.
+	 */
+	buf = pipe->split ? NULL :
+	      vsp2_histogram_buffer_get(&hgo->histo, pipe, pipe->run_sequence);
+	if (!buf) {
+		vsp_par->use_module &= ~VSP_HGO_USE;
+		return;
+	}
+
+	vsp_par->use_module |= VSP_HGO_USE;
+
+#ifdef TYPE_GEN2
+	vsp_hgo->addr = buf->addr_v;
+#else
+	vsp_hgo->virt_addr = buf->addr_v;
+	vsp_hgo->hard_addr = (unsigned int)buf->addr;
+#endif
+}
+
+/*
+ * vsp2_hgo_histogram - Histogram written by a retired job
+ * @hgo: the HGO
+ * @pipe: the pipeline the job ran on
+ * @seq: sequence number of the job
+ * @num_bins: number of bins of each histogram
+ *
+ * The HGO writes three histograms of 64 bins, for the R, G and B components,
+ * or a single histogram of 256 bins, depending on the step mode. Must be
+ * called with the pipeline irqlock held, before the histogram buffer of the
+ * job is completed.
+ *
+ * Return the histograms, or NULL if the job ran without the HGO.
+ */
+const u32 *vsp2_hgo_histogram(struct vsp2_hgo *hgo, struct vsp2_pipeline *pipe,
+			      unsigned int seq, unsigned int *num_bins)
+{
+	struct vsp2_histogram_buffer *buf;
+
+	*num_bins = hgo->config.step_mode == 0x00 /*VSP_STEP_64*/ ? 64 : 256;
+
+	if (vsp2_histogram_streaming(&hgo->histo)) {
+		buf = vsp2_histogram_buffer_find(&hgo->histo, pipe, seq);
+		return buf ? buf->addr_v : NULL;
+	}
+
+#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
+	/* All jobs write to the same buffer, which holds the histogram of a
+	 * recent frame.
+	 */
+	if (hgo->enabled && hgo->buff_v)
+		return hgo->buff_v;
+#endif
+
+	return NULL;
+}
+
+static void hgo_destroy(struct vsp2_entity *entity)
+{
+	struct vsp2_hgo *hgo = to_hgo(&entity->subdev);
+
+	vsp2_histogram_cleanup(&hgo->histo);
+
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (hgo->active_pin)
+		vsp2_addr_unpin(hgo->entity.vsp2, hgo->active_pin);
+	if (hgo->pin)
+		vsp2_addr_unpin(hgo->entity.vsp2, hgo->pin);
+#endif
+}
+
 static const struct vsp2_entity_operations hgo_entity_ops = {
+	.destroy = hgo_destroy,
 	.configure = hgo_configure,
 };
 
@@ -190,12 +310,22 @@ struct vsp2_hgo *vsp2_hgo_create(struct vsp2_device *vsp2)
 	if (ret < 0)
 		return ERR_PTR(ret);
 
+	hgo->entity.subdev.internal_ops = &vsp2_addr_internal_ops;
+
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	hgo->buff_v = dma_alloc_coherent(vsp2->dev,
 					 HGO_BUFF_SIZE, &hgo->buff_h,
-					 GFP_KERNEL | GFP_DMA);
+					 GFP_KERNEL);
 #endif
 
+	/* Initialize the histogram video node. */
+	ret = vsp2_histogram_init(vsp2, &hgo->histo, hgo->entity.subdev.name,
+				  V4L2_META_FMT_VSP2_HGO, HGO_BUFF_SIZE);
+	if (ret < 0) {
+		vsp2_entity_destroy(&hgo->entity);
+		return ERR_PTR(ret);
+	}
+
 	return hgo;
 }
 
@@ -204,9 +334,19 @@ struct vsp2_hgo *vsp2_hgo_create(struct vsp2_device *vsp2)
  */
 void vsp2_hgo_buffer_finish(struct vsp2_hgo *hgo)
 {
+	/* Histograms are delivered through the video node when it streams. */
+	if (vsp2_histogram_streaming(&hgo->histo))
+		return;
+
 #ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
-	if (hgo->set_hgo == 1)
+	if (hgo->set_hgo == 1) {
 		hgo->set_hgo = 0;
+
+		/* The hardware wrote the histogram to the user memory. */
+		if (hgo->active_pin)
+			vsp2_addr_sync_for_cpu(hgo->entity.vsp2,
+					       hgo->active_pin);
+	}
 #else
 	int remain;
 	int i;
@@ -62,28 +62,38 @@
 #include <media/v4l2-subdev.h>
 #include <linux/vsp2.h>
 
+#include "vsp2_addr.h"
 #include "vsp2_entity.h"
+#include "vsp2_histo.h"
 
 struct vsp2_device;
+struct vsp2_pipeline;
 
-#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 #define	HGO_BUFF_SIZE		(1088)
-#endif
 
 struct vsp2_hgo {
 	/* entitiy */
 	struct vsp2_entity		entity;
+	struct vsp2_pipeline	*pipe;	/* protected by the graph_mutex */
 
 	/* control */
 	u32						set_hgo;
+	bool					enabled;
 
 	/* config */
 	struct vsp2_hgo_config	config;
 
+	/* histogram video node */
+	struct vsp2_histogram	histo;
+
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	/* buffer */
 	void					*buff_v;
 	dma_addr_t				buff_h;
+#else
+	/* pinned user memory, of the last config and of the stream */
+	struct vsp2_addr_pin	*pin;
+	struct vsp2_addr_pin	*active_pin;
 #endif
 };
 
@@ -94,5 +104,8 @@ static inline struct vsp2_hgo *to_hgo(struct v4l2_subdev *subdev)
 
 struct vsp2_hgo	*vsp2_hgo_create(struct vsp2_device *vsp2);
 void vsp2_hgo_buffer_finish(struct vsp2_hgo *hgo);
+void vsp2_hgo_prepare(struct vsp2_hgo *hgo, struct vsp2_pipeline *pipe);
+const u32 *vsp2_hgo_histogram(struct vsp2_hgo *hgo, struct vsp2_pipeline *pipe,
+			      unsigned int seq, unsigned int *num_bins);
 
 #endif /* __VSP2_HGO_H__ */
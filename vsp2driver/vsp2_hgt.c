@@ -63,6 +63,8 @@
 
 #include "vsp2_device.h"
 #include "vsp2_hgt.h"
+#include "vsp2_pipe.h"
+#include "vsp2_regs.h"
 #include "vsp2_vspm.h"
 #include "vsp2_addr.h"
 
@@ -70,15 +72,102 @@
 #include <linux/dma-mapping.h>	/* for dl_par */
 #endif
 
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+/* VSPM writes x_skip and y_skip as is to the HRATIO and VRATIO fields of the
+ * VI6_HGT_MODE register, VSP_SKIP_OFF being 0 (R-Car Gen3 hardware manual,
+ * HGT mode register).
+ */
+static const unsigned int hgt_skip_modes[] = {
+	[VSP2_HGT_SKIP_OFF] = VI6_HGT_MODE_RATIO_NONE,
+	[VSP2_HGT_SKIP_1_2] = VI6_HGT_MODE_RATIO_1_2,
+	[VSP2_HGT_SKIP_1_4] = VI6_HGT_MODE_RATIO_1_4,
+};
+
+static int hgt_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_hgt *hgt =
+		container_of(ctrl->handler, struct vsp2_hgt, ctrls);
+
+	switch (ctrl->id) {
+	case VSP2_CID_HGT_OFFSET:
+		memcpy(hgt->offset, ctrl->p_new.p_u16, sizeof(hgt->offset));
+		break;
+	case VSP2_CID_HGT_SKIP:
+		memcpy(hgt->skip, ctrl->p_new.p_u8, sizeof(hgt->skip));
+		break;
+	case VSP2_CID_HGT_INTERVAL:
+		WRITE_ONCE(hgt->interval, ctrl->val);
+		break;
+	}
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops hgt_ctrl_ops = {
+	.s_ctrl = hgt_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config hgt_offset_ctrl = {
+	.ops = &hgt_ctrl_ops,
+	.id = VSP2_CID_HGT_OFFSET,
+	.name = "Histogram Offset",
+	.type = V4L2_CTRL_TYPE_U16,
+	.min = 0,
+	.max = 8190,
+	.step = 1,
+	.def = 0,
+	.dims = { 2 },
+};
+
+static const struct v4l2_ctrl_config hgt_skip_ctrl = {
+	.ops = &hgt_ctrl_ops,
+	.id = VSP2_CID_HGT_SKIP,
+	.name = "Histogram Skip",
+	.type = V4L2_CTRL_TYPE_U8,
+	.min = VSP2_HGT_SKIP_OFF,
+	.max = VSP2_HGT_SKIP_1_4,
+	.step = 1,
+	.def = VSP2_HGT_SKIP_OFF,
+	.dims = { 2 },
+};
+
+static const struct v4l2_ctrl_config hgt_interval_ctrl = {
+	.ops = &hgt_ctrl_ops,
+	.id = VSP2_CID_HGT_INTERVAL,
+	.name = "Histogram Interval",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 1,
+	.max = 255,
+	.step = 1,
+	.def = 1,
+};
+
 /* -----------------------------------------------------------------------------
  * V4L2 Subdevice Core Operations
  */
 
-static void hgt_set_config(struct vsp2_hgt *hgt, struct vsp2_hgt_config *config)
+static int hgt_set_config(struct vsp2_hgt *hgt, struct vsp2_hgt_config *config)
 {
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	struct vsp2_addr_pin *pin;
+
+	pin = vsp2_addr_pin(hgt->entity.vsp2, config->addr, HGT_BUFF_SIZE);
+	if (IS_ERR(pin))
+		return PTR_ERR(pin);
+
+	if (hgt->pin)
+		vsp2_addr_unpin(hgt->entity.vsp2, hgt->pin);
+	hgt->pin = pin;
+#endif
+
 	hgt->set_hgt = 1; /* set HGT parameter from user */
 
 	memcpy(&hgt->config, config, sizeof(struct vsp2_hgt_config));
+
+	return 0;
 }
 
 static long hgt_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
@@ -87,8 +176,10 @@ static long hgt_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
 
 	switch (cmd) {
 	case VIDIOC_VSP2_HGT_CONFIG:
-		hgt_set_config(hgt, arg);
-		return 0;
+		return hgt_set_config(hgt, arg);
+
+	case VIDIOC_VSP2_ADDR_UNREGISTER:
+		return vsp2_addr_unregister(hgt->entity.vsp2, arg);
 
 	default:
 		return -ENOIOCTLCMD;
@@ -145,31 +236,136 @@ static void hgt_configure(struct vsp2_entity *entity,
 		vsp_hgt->hard_addr = (unsigned int)hgt->buff_h;
 	#endif
 #else
+		/* The stream keeps its memory pinned until the next one. */
+		if (hgt->pin)
+			vsp2_addr_get(hgt->entity.vsp2, hgt->pin);
+		if (hgt->active_pin)
+			vsp2_addr_unpin(hgt->entity.vsp2, hgt->active_pin);
+		hgt->active_pin = hgt->pin;
+
+		if (!hgt->active_pin) {
+			VSP2_PRINT_ALERT("%s() error!!", __func__);
+			return;
+		}
 	#ifdef TYPE_GEN2
-		vsp_hgt->addr = (void *)vsp2_addr_uv2hd(
-			(unsigned long)hgt->config.addr);
+		vsp_hgt->addr = (void *)(unsigned long)hgt->active_pin->addr;
 	#else
 		vsp_hgt->virt_addr = NULL;
-		vsp_hgt->hard_addr = (unsigned int)vsp2_addr_uv2hd(
-			(unsigned long)hgt->config.addr);
+		vsp_hgt->hard_addr = (unsigned int)hgt->active_pin->addr;
 	#endif
 #endif
 		vsp_hgt->width		= hgt->config.width;
 		vsp_hgt->height		= hgt->config.height;
-		vsp_hgt->x_offset	= 0;
-		vsp_hgt->y_offset	= 0;
-		vsp_hgt->x_skip		= VSP_SKIP_OFF;
-		vsp_hgt->y_skip		= VSP_SKIP_OFF;
+		vsp_hgt->x_offset	= hgt->offset[0];
+		vsp_hgt->y_offset	= hgt->offset[1];
+		vsp_hgt->x_skip		= hgt_skip_modes[hgt->skip[0]];
+		vsp_hgt->y_skip		= hgt_skip_modes[hgt->skip[1]];
 
 		for (i = 0; i < 6; i++) {
 			vsp_hgt->area[i].lower	= hgt->config.area[i].lower;
 			vsp_hgt->area[i].upper	= hgt->config.area[i].upper;
 		}
 		vsp_hgt->sampling	= hgt->config.sampling;
+
+		hgt->count = 0;
 	}
 }
 
+/*
+ * vsp2_hgt_validate - Check the histogram area against the pipeline frames
+ * @hgt: the HGT
+ * @pipe: the pipeline the HGT is attached to
+ *
+ * The sampling point is selected by the VSPM sampling parameter and isn't
+ * known to the driver, the area set by VIDIOC_VSP2_HGT_CONFIG and
+ * VSP2_CID_HGT_OFFSET must fit in the largest frame of the pipeline.
+ *
+ * Return 0 on success or -EINVAL if the area is out of the frames.
+ */
+int vsp2_hgt_validate(struct vsp2_hgt *hgt, struct vsp2_pipeline *pipe)
+{
+	struct v4l2_mbus_framefmt *format;
+	struct vsp2_entity *entity;
+	unsigned int width = 0;
+	unsigned int height = 0;
+
+	if (hgt->set_hgt != 1)
+		return 0;
+
+	list_for_each_entry(entity, &pipe->entities, list_pipe) {
+		format = vsp2_entity_get_pad_format(entity, entity->config,
+						    entity->source_pad);
+		width = max(width, format->width);
+		height = max(height, format->height);
+	}
+
+	if (hgt->offset[0] + hgt->config.width > width ||
+	    hgt->offset[1] + hgt->config.height > height) {
+		dev_dbg(hgt->entity.vsp2->dev,
+			"hgt: area %ux%u@(%u,%u) out of the %ux%u frame\n",
+			hgt->config.width, hgt->config.height,
+			hgt->offset[0], hgt->offset[1], width, height);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * vsp2_hgt_prepare - Hand the next histogram buffer to a job
+ * @hgt: the HGT
+ * @pipe: the pipeline the job runs on
+ *
+ * When the histogram video node is streaming, the HGT writes the histogram of
+ * one job out of VSP2_CID_HGT_INTERVAL straight to the next queued buffer.
+ * The other jobs, jobs for which no buffer is queued and split jobs run
+ * without the HGT. Must be called with the pipeline irqlock held, right
+ * before the job is handed to VSPM.
+ */
+void vsp2_hgt_prepare(struct vsp2_hgt *hgt, struct vsp2_pipeline *pipe)
+{
+	struct vsp_start_t *vsp_par =
+		hgt->entity.vsp2->vspm->ip_par.par.vsp;
+	struct vsp_hgt_t *vsp_hgt = vsp_par->ctrl_par->hgt;
+	struct vsp2_histogram_buffer *buf = NULL;
+
+	if (hgt->set_hgt != 1 || !vsp2_histogram_streaming(&hgt->histo))
+		return;
+
+	if (hgt->count++ % READ_ONCE(hgt->interval) == 0 && !pipe->split)
+		buf = vsp2_histogram_buffer_get(&hgt->histo, pipe,
+						pipe->run_sequence);
+	if (!buf) {
+		vsp_par->use_module &= ~VSP_HGT_USE;
+		return;
+	}
+
+	vsp_par->use_module |= VSP_HGT_USE;
+
+#ifdef TYPE_GEN2
+	vsp_hgt->addr = buf->addr_v;
+#else
+	vsp_hgt->virt_addr = buf->addr_v;
+	vsp_hgt->hard_addr = (unsigned int)buf->addr;
+#endif
+}
+
+static void hgt_destroy(struct vsp2_entity *entity)
+{
+	struct vsp2_hgt *hgt = to_hgt(&entity->subdev);
+
+	vsp2_histogram_cleanup(&hgt->histo);
+
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (hgt->active_pin)
+		vsp2_addr_unpin(hgt->entity.vsp2, hgt->active_pin);
+	if (hgt->pin)
+		vsp2_addr_unpin(hgt->entity.vsp2, hgt->pin);
+#endif
+}
+
 static const struct vsp2_entity_operations hgt_entity_ops = {
+	.destroy = hgt_destroy,
 	.configure = hgt_configure,
 };
 
@@ -194,12 +390,39 @@ struct vsp2_hgt *vsp2_hgt_create(struct vsp2_device *vsp2)
 	if (ret < 0)
 		return ERR_PTR(ret);
 
+	hgt->entity.subdev.internal_ops = &vsp2_addr_internal_ops;
+
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	hgt->buff_v = dma_alloc_coherent(vsp2->dev,
 					 HGT_BUFF_SIZE, &hgt->buff_h,
-					 GFP_KERNEL | GFP_DMA);
+					 GFP_KERNEL);
 #endif
 
+	/* Initialize the control handler. */
+	v4l2_ctrl_handler_init(&hgt->ctrls, 3);
+	v4l2_ctrl_new_custom(&hgt->ctrls, &hgt_offset_ctrl, NULL);
+	v4l2_ctrl_new_custom(&hgt->ctrls, &hgt_skip_ctrl, NULL);
+	v4l2_ctrl_new_custom(&hgt->ctrls, &hgt_interval_ctrl, NULL);
+
+	hgt->interval = 1;
+
+	hgt->entity.subdev.ctrl_handler = &hgt->ctrls;
+
+	if (hgt->ctrls.error) {
+		dev_err(vsp2->dev, "hgt: failed to initialize controls\n");
+		ret = hgt->ctrls.error;
+		vsp2_entity_destroy(&hgt->entity);
+		return ERR_PTR(ret);
+	}
+
+	/* Initialize the histogram video node. */
+	ret = vsp2_histogram_init(vsp2, &hgt->histo, hgt->entity.subdev.name,
+				  V4L2_META_FMT_VSP2_HGT, HGT_BUFF_SIZE);
+	if (ret < 0) {
+		vsp2_entity_destroy(&hgt->entity);
+		return ERR_PTR(ret);
+	}
+
 	return hgt;
 }
 
@@ -208,9 +431,19 @@ struct vsp2_hgt *vsp2_hgt_create(struct vsp2_device *vsp2)
  */
 void vsp2_hgt_buffer_finish(struct vsp2_hgt *hgt)
 {
+	/* Histograms are delivered through the video node when it streams. */
+	if (vsp2_histogram_streaming(&hgt->histo))
+		return;
+
 #ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
-	if (hgt->set_hgt == 1)
+	if (hgt->set_hgt == 1) {
 		hgt->set_hgt = 0;
+
+		/* The hardware wrote the histogram to the user memory. */
+		if (hgt->active_pin)
+			vsp2_addr_sync_for_cpu(hgt->entity.vsp2,
+					       hgt->active_pin);
+	}
 #else
 	int remain;
 	int i;
@@ -59,31 +59,46 @@
 #define __VSP2_HGT_H__
 
 #include <media/media-entity.h>
+#include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 #include <linux/vsp2.h>
 
+#include "vsp2_addr.h"
 #include "vsp2_entity.h"
+#include "vsp2_histo.h"
 
 struct vsp2_device;
+struct vsp2_pipeline;
 
-#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 #define	HGT_BUFF_SIZE	(800)
-#endif
 
 struct vsp2_hgt {
 	/* entity */
 	struct vsp2_entity		entity;
+	struct vsp2_pipeline	*pipe;	/* protected by the graph_mutex */
 
 	/* control */
 	u32						set_hgt;
 
 	/* config */
 	struct vsp2_hgt_config	config;
+	struct v4l2_ctrl_handler	ctrls;
+	u16						offset[2];
+	u8						skip[2];
+	unsigned int			interval;
+	unsigned int			count;
+
+	/* histogram video node */
+	struct vsp2_histogram	histo;
 
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	/* buffer */
 	void					*buff_v;
 	dma_addr_t				buff_h;
+#else
+	/* pinned user memory, of the last config and of the stream */
+	struct vsp2_addr_pin	*pin;
+	struct vsp2_addr_pin	*active_pin;
 #endif
 };
 
@@ -94,5 +109,7 @@ static inline struct vsp2_hgt *to_hgt(struct v4l2_subdev *subdev)
 
 struct vsp2_hgt *vsp2_hgt_create(struct vsp2_device *vsp2);
 void vsp2_hgt_buffer_finish(struct vsp2_hgt *hgt);
+int vsp2_hgt_validate(struct vsp2_hgt *hgt, struct vsp2_pipeline *pipe);
+void vsp2_hgt_prepare(struct vsp2_hgt *hgt, struct vsp2_pipeline *pipe);
 
 #endif /* __VSP2_HGT_H__ */
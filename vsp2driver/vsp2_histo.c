@@ -0,0 +1,499 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+
+#include <linux/device.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/videodev2.h>
+
+#include <media/v4l2-dev.h>
+#include <media/v4l2-fh.h>
+#include <media/v4l2-ioctl.h>
+#include <media/videobuf2-dma-contig.h>
+
+#include "vsp2_device.h"
+#include "vsp2_histo.h"
+#include "vsp2_addr.h"
+
+static inline struct vsp2_histogram_buffer *
+to_vsp2_histogram_buffer(struct vb2_v4l2_buffer *vbuf)
+{
+	return container_of(vbuf, struct vsp2_histogram_buffer, buf);
+}
+
+/* -----------------------------------------------------------------------------
+ * Buffer Operations
+ */
+
+bool vsp2_histogram_streaming(struct vsp2_histogram *histo)
+{
+	return READ_ONCE(histo->streaming);
+}
+
+/*
+ * vsp2_histogram_buffer_get - Select the buffer of the next job
+ * @histo: the histogram
+ * @pipe: the pipeline the job runs on
+ * @seq: sequence number of the job
+ *
+ * Return the oldest queued buffer not handed to the hardware yet, or NULL if
+ * none is available or the video node isn't streaming.
+ */
+struct vsp2_histogram_buffer *
+vsp2_histogram_buffer_get(struct vsp2_histogram *histo,
+			  struct vsp2_pipeline *pipe, unsigned int seq)
+{
+	struct vsp2_histogram_buffer *buf;
+	unsigned long flags;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+
+	if (!histo->streaming)
+		goto done;
+
+	/* A job that failed to start is retried with the same sequence
+	 * number, reuse the buffer it was given.
+	 */
+	list_for_each_entry(buf, &histo->irqqueue, queue) {
+		if (buf->active && buf->pipe == pipe && buf->seq == seq) {
+			spin_unlock_irqrestore(&histo->irqlock, flags);
+			return buf;
+		}
+	}
+
+	list_for_each_entry(buf, &histo->irqqueue, queue) {
+		if (buf->active)
+			continue;
+
+		buf->active = true;
+		buf->pipe = pipe;
+		buf->seq = seq;
+		spin_unlock_irqrestore(&histo->irqlock, flags);
+		return buf;
+	}
+
+done:
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+	return NULL;
+}
+
+/*
+ * vsp2_histogram_buffer_find - Find the buffer of a retired job
+ * @histo: the histogram
+ * @pipe: the pipeline the job ran on
+ * @seq: sequence number of the job
+ *
+ * MMAP buffers are allocated coherent by vb2, their content can be read by
+ * the CPU as soon as the job has completed.
+ *
+ * Return the buffer the job wrote its histogram to, or NULL if the job ran
+ * without a buffer. The buffer stays valid until it is completed.
+ */
+struct vsp2_histogram_buffer *
+vsp2_histogram_buffer_find(struct vsp2_histogram *histo,
+			   struct vsp2_pipeline *pipe, unsigned int seq)
+{
+	struct vsp2_histogram_buffer *buf;
+	unsigned long flags;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+
+	list_for_each_entry(buf, &histo->irqqueue, queue) {
+		if (buf->active && buf->pipe == pipe && buf->seq == seq) {
+			spin_unlock_irqrestore(&histo->irqlock, flags);
+			return buf;
+		}
+	}
+
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+	return NULL;
+}
+
+/*
+ * vsp2_histogram_buffer_complete - Complete the buffer of a retired job
+ * @histo: the histogram
+ * @pipe: the pipeline the job ran on
+ * @seq: sequence number of the job
+ */
+void vsp2_histogram_buffer_complete(struct vsp2_histogram *histo,
+				    struct vsp2_pipeline *pipe,
+				    unsigned int seq)
+{
+	struct vsp2_histogram_buffer *buf;
+	unsigned long flags;
+	bool found = false;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+
+	list_for_each_entry(buf, &histo->irqqueue, queue) {
+		if (buf->active && buf->pipe == pipe && buf->seq == seq) {
+			list_del(&buf->queue);
+			found = true;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+
+	if (!found)
+		return;
+
+	buf->buf.sequence = seq;
+	buf->buf.vb2_buf.timestamp = ktime_get_ns();
+	vb2_set_plane_payload(&buf->buf.vb2_buf, 0, histo->data_size);
+	vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_DONE);
+
+	wake_up(&histo->wait_queue);
+}
+
+static bool vsp2_histogram_busy(struct vsp2_histogram *histo)
+{
+	struct vsp2_histogram_buffer *buf;
+	unsigned long flags;
+	bool busy = false;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+
+	list_for_each_entry(buf, &histo->irqqueue, queue) {
+		if (buf->active) {
+			busy = true;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+
+	return busy;
+}
+
+/* -----------------------------------------------------------------------------
+ * videobuf2 Queue Operations
+ */
+
+static int vsp2_histogram_queue_setup(struct vb2_queue *vq,
+				      unsigned int *nbuffers,
+				      unsigned int *nplanes,
+				      unsigned int sizes[],
+				      struct device *alloc_devs[])
+{
+	struct vsp2_histogram *histo = vb2_get_drv_priv(vq);
+
+	if (*nplanes) {
+		if (*nplanes != 1)
+			return -EINVAL;
+
+		if (sizes[0] < histo->data_size)
+			return -EINVAL;
+
+		return 0;
+	}
+
+	*nplanes = 1;
+	sizes[0] = histo->data_size;
+
+	return 0;
+}
+
+static int vsp2_histogram_buffer_prepare(struct vb2_buffer *vb)
+{
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct vsp2_histogram *histo = vb2_get_drv_priv(vb->vb2_queue);
+	struct vsp2_histogram_buffer *buf = to_vsp2_histogram_buffer(vbuf);
+
+	if (vb->num_planes != 1)
+		return -EINVAL;
+
+	if (vb2_plane_size(vb, 0) < histo->data_size)
+		return -EINVAL;
+
+	buf->addr = vb2_dma_contig_plane_dma_addr(vb, 0);
+	buf->addr_v = vb2_plane_vaddr(vb, 0);
+
+	/* VSPM and the LUT feedback access the histogram through the CPU. */
+	if (!buf->addr_v)
+		return -EINVAL;
+
+	if (vsp2_addr_check(histo->vsp2, buf->addr, histo->data_size) < 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void vsp2_histogram_buffer_queue(struct vb2_buffer *vb)
+{
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct vsp2_histogram *histo = vb2_get_drv_priv(vb->vb2_queue);
+	struct vsp2_histogram_buffer *buf = to_vsp2_histogram_buffer(vbuf);
+	unsigned long flags;
+
+	buf->active = false;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+	list_add_tail(&buf->queue, &histo->irqqueue);
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+}
+
+static int vsp2_histogram_start_streaming(struct vb2_queue *vq,
+					  unsigned int count)
+{
+	struct vsp2_histogram *histo = vb2_get_drv_priv(vq);
+	unsigned long flags;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+	histo->streaming = true;
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+
+	return 0;
+}
+
+static void vsp2_histogram_stop_streaming(struct vb2_queue *vq)
+{
+	struct vsp2_histogram *histo = vb2_get_drv_priv(vq);
+	struct vsp2_histogram_buffer *buf, *_buf;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+	histo->streaming = false;
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+
+	/* The hardware may still be writing to the buffers handed to jobs in
+	 * flight, wait for the jobs to be retired before returning them.
+	 */
+	ret = wait_event_timeout(histo->wait_queue,
+				 !vsp2_histogram_busy(histo),
+				 msecs_to_jiffies(500));
+	if (ret == 0)
+		dev_warn(histo->vsp2->dev, "%s: stop timeout\n",
+			 histo->video.name);
+
+	spin_lock_irqsave(&histo->irqlock, flags);
+	list_for_each_entry_safe(buf, _buf, &histo->irqqueue, queue) {
+		list_del(&buf->queue);
+		vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+	spin_unlock_irqrestore(&histo->irqlock, flags);
+}
+
+static const struct vb2_ops vsp2_histogram_queue_qops = {
+	.queue_setup = vsp2_histogram_queue_setup,
+	.buf_prepare = vsp2_histogram_buffer_prepare,
+	.buf_queue = vsp2_histogram_buffer_queue,
+	.wait_prepare = vb2_ops_wait_prepare,
+	.wait_finish = vb2_ops_wait_finish,
+	.start_streaming = vsp2_histogram_start_streaming,
+	.stop_streaming = vsp2_histogram_stop_streaming,
+};
+
+/* -----------------------------------------------------------------------------
+ * V4L2 ioctls
+ */
+
+static int vsp2_histogram_querycap(struct file *file, void *fh,
+				   struct v4l2_capability *cap)
+{
+	struct vsp2_histogram *histo = video_drvdata(file);
+
+	cap->capabilities = V4L2_CAP_DEVICE_CAPS | V4L2_CAP_STREAMING
+			  | V4L2_CAP_META_CAPTURE;
+
+	strlcpy(cap->driver, "vsp2", sizeof(cap->driver));
+	strlcpy(cap->card, histo->video.name, sizeof(cap->card));
+	snprintf(cap->bus_info, sizeof(cap->bus_info), "platform:%s",
+		 dev_name(histo->vsp2->dev));
+
+	return 0;
+}
+
+static int vsp2_histogram_enum_format(struct file *file, void *fh,
+				      struct v4l2_fmtdesc *f)
+{
+	struct vsp2_histogram *histo = video_drvdata(file);
+
+	if (f->index > 0 || f->type != histo->queue.type)
+		return -EINVAL;
+
+	f->pixelformat = histo->meta_format;
+
+	return 0;
+}
+
+static int vsp2_histogram_get_format(struct file *file, void *fh,
+				     struct v4l2_format *format)
+{
+	struct vsp2_histogram *histo = video_drvdata(file);
+	struct v4l2_meta_format *meta = &format->fmt.meta;
+
+	if (format->type != histo->queue.type)
+		return -EINVAL;
+
+	memset(meta, 0, sizeof(*meta));
+
+	meta->dataformat = histo->meta_format;
+	meta->buffersize = histo->data_size;
+
+	return 0;
+}
+
+static const struct v4l2_ioctl_ops vsp2_histogram_ioctl_ops = {
+	.vidioc_querycap		= vsp2_histogram_querycap,
+	.vidioc_enum_fmt_meta_cap	= vsp2_histogram_enum_format,
+	.vidioc_g_fmt_meta_cap		= vsp2_histogram_get_format,
+	.vidioc_s_fmt_meta_cap		= vsp2_histogram_get_format,
+	.vidioc_try_fmt_meta_cap	= vsp2_histogram_get_format,
+	.vidioc_reqbufs			= vb2_ioctl_reqbufs,
+	.vidioc_querybuf		= vb2_ioctl_querybuf,
+	.vidioc_qbuf			= vb2_ioctl_qbuf,
+	.vidioc_dqbuf			= vb2_ioctl_dqbuf,
+	.vidioc_create_bufs		= vb2_ioctl_create_bufs,
+	.vidioc_prepare_buf		= vb2_ioctl_prepare_buf,
+	.vidioc_expbuf			= vb2_ioctl_expbuf,
+	.vidioc_streamon		= vb2_ioctl_streamon,
+	.vidioc_streamoff		= vb2_ioctl_streamoff,
+};
+
+/* -----------------------------------------------------------------------------
+ * V4L2 File Operations
+ */
+
+static const struct v4l2_file_operations vsp2_histogram_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = video_ioctl2,
+	.open = v4l2_fh_open,
+	.release = vb2_fop_release,
+	.poll = vb2_fop_poll,
+	.mmap = vb2_fop_mmap,
+};
+
+/* -----------------------------------------------------------------------------
+ * Initialization and Cleanup
+ */
+
+int vsp2_histogram_init(struct vsp2_device *vsp2,
+			struct vsp2_histogram *histo, const char *name,
+			u32 meta_format, size_t data_size)
+{
+	int ret;
+
+	histo->vsp2 = vsp2;
+	histo->meta_format = meta_format;
+	histo->data_size = data_size;
+
+	mutex_init(&histo->lock);
+	spin_lock_init(&histo->irqlock);
+	INIT_LIST_HEAD(&histo->irqqueue);
+	init_waitqueue_head(&histo->wait_queue);
+
+	/* Initialize the media entity... */
+	histo->pad.flags = MEDIA_PAD_FL_SINK;
+	ret = media_entity_pads_init(&histo->video.entity, 1, &histo->pad);
+	if (ret < 0)
+		return ret;
+
+	/* ... and the video node... */
+	histo->video.v4l2_dev = &vsp2->v4l2_dev;
+	histo->video.fops = &vsp2_histogram_fops;
+	snprintf(histo->video.name, sizeof(histo->video.name),
+		 "%s histo", name);
+	histo->video.vfl_type = VFL_TYPE_VIDEO;
+	histo->video.vfl_dir = VFL_DIR_RX;
+	histo->video.device_caps = V4L2_CAP_META_CAPTURE |
+				   V4L2_CAP_STREAMING;
+	histo->video.release = video_device_release_empty;
+	histo->video.ioctl_ops = &vsp2_histogram_ioctl_ops;
+	histo->video.lock = &histo->lock;
+
+	video_set_drvdata(&histo->video, histo);
+
+	histo->queue.type = V4L2_BUF_TYPE_META_CAPTURE;
+	histo->queue.io_modes = VB2_MMAP | VB2_DMABUF;
+	histo->queue.lock = &histo->lock;
+	histo->queue.drv_priv = histo;
+	histo->queue.buf_struct_size = sizeof(struct vsp2_histogram_buffer);
+	histo->queue.ops = &vsp2_histogram_queue_qops;
+	histo->queue.mem_ops = &vb2_dma_contig_memops;
+	histo->queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	histo->queue.dev = vsp2->dev;
+	ret = vb2_queue_init(&histo->queue);
+	if (ret < 0) {
+		dev_err(vsp2->dev, "failed to initialize vb2 queue\n");
+		goto error;
+	}
+
+	/* ... and register the video device. */
+	histo->video.queue = &histo->queue;
+	ret = video_register_device(&histo->video, VFL_TYPE_VIDEO, -1);
+	if (ret < 0) {
+		dev_err(vsp2->dev, "failed to register video device\n");
+		goto error;
+	}
+
+	return 0;
+
+error:
+	vsp2_histogram_cleanup(histo);
+	return ret;
+}
+
+void vsp2_histogram_cleanup(struct vsp2_histogram *histo)
+{
+	if (video_is_registered(&histo->video))
+		video_unregister_device(&histo->video);
+
+	media_entity_cleanup(&histo->video.entity);
+}
@@ -0,0 +1,144 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+
+#ifndef __VSP2_HISTO_H__
+#define __VSP2_HISTO_H__
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include <media/media-entity.h>
+#include <media/v4l2-dev.h>
+#include <media/videobuf2-v4l2.h>
+
+struct vsp2_device;
+struct vsp2_pipeline;
+
+/*
+ * struct vsp2_histogram_buffer - Histogram buffer
+ * @buf: the videobuf2 buffer
+ * @queue: entry in the histogram irqqueue
+ * @addr: device address of the buffer
+ * @addr_v: kernel address of the buffer
+ * @pipe: pipeline of the job writing to the buffer, when active
+ * @seq: sequence number of the job writing to the buffer, when active
+ * @active: handed to the hardware
+ */
+struct vsp2_histogram_buffer {
+	struct vb2_v4l2_buffer buf;
+	struct list_head queue;
+
+	dma_addr_t addr;
+	void *addr_v;
+	struct vsp2_pipeline *pipe;
+	unsigned int seq;
+	bool active;
+};
+
+/*
+ * struct vsp2_histogram - Histogram metadata capture video node
+ * @vsp2: the VSP2 device
+ * @video: the video device
+ * @pad: media pad of the video device
+ * @lock: protects the video queue
+ * @queue: the videobuf2 queue
+ * @irqlock: protects the irqqueue and streaming flag
+ * @irqqueue: queued buffers, in queue order
+ * @wait_queue: wait queue to wait for active buffers completion
+ * @meta_format: V4L2 metadata format
+ * @data_size: size of the histogram data
+ * @streaming: buffers can be handed to the hardware
+ *
+ * The hardware writes the histogram of a job straight to the buffer handed
+ * to it, the buffer is completed when the job is retired.
+ */
+struct vsp2_histogram {
+	struct vsp2_device *vsp2;
+	struct video_device video;
+	struct media_pad pad;
+
+	struct mutex lock;	/* protects the video queue */
+	struct vb2_queue queue;
+	spinlock_t irqlock;	/* protects the irqqueue */
+	struct list_head irqqueue;
+	wait_queue_head_t wait_queue;
+
+	u32 meta_format;
+	size_t data_size;
+	bool streaming;
+};
+
+int vsp2_histogram_init(struct vsp2_device *vsp2,
+			struct vsp2_histogram *histo, const char *name,
+			u32 meta_format, size_t data_size);
+void vsp2_histogram_cleanup(struct vsp2_histogram *histo);
+
+bool vsp2_histogram_streaming(struct vsp2_histogram *histo);
+struct vsp2_histogram_buffer *
+vsp2_histogram_buffer_get(struct vsp2_histogram *histo,
+			  struct vsp2_pipeline *pipe, unsigned int seq);
+struct vsp2_histogram_buffer *
+vsp2_histogram_buffer_find(struct vsp2_histogram *histo,
+			   struct vsp2_pipeline *pipe, unsigned int seq);
+void vsp2_histogram_buffer_complete(struct vsp2_histogram *histo,
+				    struct vsp2_pipeline *pipe,
+				    unsigned int seq);
+
+#endif /* __VSP2_HISTO_H__ */
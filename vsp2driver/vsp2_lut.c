@@ -57,28 +57,284 @@
 
 #include <linux/device.h>
 #include <linux/gfp.h>
+#include <linux/math64.h>
 
 #include <media/v4l2-subdev.h>
 
 #include "vsp2_device.h"
 #include "vsp2_lut.h"
+#include "vsp2_pipe.h"
+#include "vsp2_regs.h"
 #include "vsp2_vspm.h"
 #include "vsp2_addr.h"
 
-#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 #include <linux/dma-mapping.h>	/* for dl_par */
-#endif
 
 #define LUT_MIN_SIZE	(1U)
 #define LUT_MAX_SIZE	(8190U)
 
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+static int lut_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_lut *lut =
+		container_of(ctrl->handler, struct vsp2_lut, ctrls);
+
+	switch (ctrl->id) {
+	case VSP2_CID_LUT_AUTO:
+		WRITE_ONCE(lut->auto_mode, ctrl->val);
+		break;
+
+	case VSP2_CID_LUT_AUTO_CLIP:
+		WRITE_ONCE(lut->auto_clip, ctrl->val);
+		break;
+
+	case VSP2_CID_LUT_AUTO_SMOOTH:
+		WRITE_ONCE(lut->auto_smooth, ctrl->val);
+		break;
+	}
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops lut_ctrl_ops = {
+	.s_ctrl = lut_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config lut_auto_ctrl = {
+	.ops = &lut_ctrl_ops,
+	.id = VSP2_CID_LUT_AUTO,
+	.name = "Automatic Table",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = VSP2_LUT_AUTO_OFF,
+	.max = VSP2_LUT_AUTO_STRETCH,
+	.step = 1,
+	.def = VSP2_LUT_AUTO_OFF,
+};
+
+static const struct v4l2_ctrl_config lut_auto_clip_ctrl = {
+	.ops = &lut_ctrl_ops,
+	.id = VSP2_CID_LUT_AUTO_CLIP,
+	.name = "Automatic Table Clipping",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = 250,
+	.step = 1,
+	.def = 5,
+};
+
+static const struct v4l2_ctrl_config lut_auto_smooth_ctrl = {
+	.ops = &lut_ctrl_ops,
+	.id = VSP2_CID_LUT_AUTO_SMOOTH,
+	.name = "Automatic Table Smoothing",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = 15,
+	.step = 1,
+	.def = 12,
+};
+
 /* -----------------------------------------------------------------------------
  * V4L2 Subdevice Core Operations
  */
 
-static void lut_set_config(struct vsp2_lut *lut, struct vsp2_lut_config *config)
+/*
+ * lut_get_slot - Select the table slot to fill with a new table
+ * @lut: the LUT
+ * @atomic: the caller can't sleep, slots holding a dmabuf are skipped as
+ *	    they can't be unmapped
+ *
+ * A pending table not handed to the hardware yet is replaced. Otherwise the
+ * slot must not be the active one, nor be read by a job still in flight.
+ * The selected slot is withdrawn from the pending state so that no job picks
+ * it up while it is being written, and must be released with
+ * lut_publish_slot() or lut_put_slot().
+ *
+ * Return the slot index or -EBUSY if all slots are in use.
+ */
+static int lut_get_slot(struct vsp2_lut *lut, bool atomic)
+{
+	struct vsp2_pipeline *pipe = lut->pipe;
+	unsigned long flags;
+	int slot = -EBUSY;
+	int i;
+
+	spin_lock_irqsave(&lut->slot_lock, flags);
+
+	if (lut->pending >= 0 &&
+	    !(atomic && lut->dmabuf[lut->pending].dbuf)) {
+		slot = lut->pending;
+		lut->pending = -1;
+		goto done;
+	}
+
+	for (i = 0; i < LUT_NUM_SLOTS; ++i) {
+		if (i == lut->active || i == lut->pending ||
+		    lut->writing & (1 << i))
+			continue;
+
+		if (atomic && lut->dmabuf[i].dbuf)
+			continue;
+
+		/* Jobs are retired in sequence order, the slot is idle once
+		 * the last job that used it has completed.
+		 */
+		if (lut->busy & (1 << i) && pipe &&
+		    (int)(READ_ONCE(pipe->sequence) - lut->last_seq[i]) <= 0)
+			continue;
+
+		lut->busy &= ~(1 << i);
+		slot = i;
+		break;
+	}
+
+done:
+	if (slot >= 0)
+		lut->writing |= 1 << slot;
+
+	spin_unlock_irqrestore(&lut->slot_lock, flags);
+	return slot;
+}
+
+/* Release a slot without publishing its table. */
+static void lut_put_slot(struct vsp2_lut *lut, int slot)
 {
-	memcpy(&lut->config, config, sizeof(struct vsp2_lut_config));
+	unsigned long flags;
+
+	spin_lock_irqsave(&lut->slot_lock, flags);
+	lut->writing &= ~(1 << slot);
+	spin_unlock_irqrestore(&lut->slot_lock, flags);
+}
+
+/*
+ * Publish the table, the next job submitted switches to it. @computed tells
+ * whether the table has been computed by the driver.
+ */
+static void lut_publish_slot(struct vsp2_lut *lut, int slot, bool computed)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lut->slot_lock, flags);
+	lut->writing &= ~(1 << slot);
+	lut->pending = slot;
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (computed)
+		lut->auto_slots |= 1 << slot;
+	else
+		lut->auto_slots &= ~(1 << slot);
+#endif
+	spin_unlock_irqrestore(&lut->slot_lock, flags);
+}
+
+static int lut_set_config(struct vsp2_lut *lut, struct vsp2_lut_config *config)
+{
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	struct vsp2_addr_pin *pin;
+#endif
+	int slot;
+	int ret = 0;
+
+	if (config->tbl_num > 256)
+		return -EINVAL;
+
+	mutex_lock(&lut->lock);
+
+	slot = lut_get_slot(lut, false);
+	if (slot < 0) {
+		ret = slot;
+		goto done;
+	}
+
+	vsp2_dmabuf_unmap(&lut->dmabuf[slot]);
+
+#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (!lut->buff_v[slot]) {
+		lut_put_slot(lut, slot);
+		ret = -ENOMEM;
+		goto done;
+	}
+	if (copy_from_user(lut->buff_v[slot], (void __user *)config->addr,
+			   config->tbl_num * 8)) {
+		lut_put_slot(lut, slot);
+		ret = -EFAULT;
+		goto done;
+	}
+#else
+	pin = vsp2_addr_pin(lut->entity.vsp2, (void __user *)config->addr,
+			    config->tbl_num * 8);
+	if (IS_ERR(pin)) {
+		lut_put_slot(lut, slot);
+		ret = PTR_ERR(pin);
+		goto done;
+	}
+
+	vsp2_addr_sync_for_device(lut->entity.vsp2, pin);
+
+	if (lut->pin[slot])
+		vsp2_addr_unpin(lut->entity.vsp2, lut->pin[slot]);
+	lut->pin[slot] = pin;
+#endif
+
+	memcpy(&lut->config[slot], config, sizeof(struct vsp2_lut_config));
+	lut_publish_slot(lut, slot, false);
+
+done:
+	mutex_unlock(&lut->lock);
+	return ret;
+}
+
+static int lut_set_dmabuf(struct vsp2_lut *lut,
+			  struct vsp2_lut_dmabuf_config *config)
+{
+	struct vsp2_dmabuf *dmabuf;
+	int slot;
+	int ret = 0;
+
+	if (!config->tbl_num || config->tbl_num > 256)
+		return -EINVAL;
+
+	mutex_lock(&lut->lock);
+
+	slot = lut_get_slot(lut, false);
+	if (slot < 0) {
+		ret = slot;
+		goto done;
+	}
+
+	dmabuf = &lut->dmabuf[slot];
+	vsp2_dmabuf_unmap(dmabuf);
+
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+	if (lut->pin[slot]) {
+		vsp2_addr_unpin(lut->entity.vsp2, lut->pin[slot]);
+		lut->pin[slot] = NULL;
+	}
+#endif
+
+	ret = vsp2_dmabuf_map(lut->entity.vsp2, config->fd, config->offset,
+			      config->tbl_num * 8, dmabuf);
+	if (ret < 0) {
+		lut_put_slot(lut, slot);
+		goto done;
+	}
+
+	ret = vsp2_dmabuf_vmap(dmabuf);
+	if (ret < 0) {
+		vsp2_dmabuf_unmap(dmabuf);
+		lut_put_slot(lut, slot);
+		goto done;
+	}
+
+	lut->config[slot].addr = NULL;
+	lut->config[slot].tbl_num = config->tbl_num;
+	lut->config[slot].fxa = config->fxa;
+	lut_publish_slot(lut, slot, false);
+
+done:
+	mutex_unlock(&lut->lock);
+	return ret;
 }
 
 static long lut_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
@@ -87,8 +343,13 @@ static long lut_ioctl(struct v4l2_subdev *subdev, unsigned int cmd, void *arg)
 
 	switch (cmd) {
 	case VIDIOC_VSP2_LUT_CONFIG:
-		lut_set_config(lut, arg);
-		return 0;
+		return lut_set_config(lut, arg);
+
+	case VIDIOC_VSP2_LUT_DMABUF:
+		return lut_set_dmabuf(lut, arg);
+
+	case VIDIOC_VSP2_ADDR_UNREGISTER:
+		return vsp2_addr_unregister(lut->entity.vsp2, arg);
 
 	default:
 		return -ENOIOCTLCMD;
@@ -141,6 +402,7 @@ static int lut_set_format(
 
 	/* Default to YUV if the requested format is not supported. */
 	if (fmt->format.code != MEDIA_BUS_FMT_ARGB8888_1X32 &&
+	    fmt->format.code != MEDIA_BUS_FMT_AHSV8888_1X32 &&
 	    fmt->format.code != MEDIA_BUS_FMT_AYUV8_1X32)
 		fmt->format.code = MEDIA_BUS_FMT_AYUV8_1X32;
 
@@ -203,42 +465,261 @@ static struct vsp_start_t *to_vsp_par(struct vsp2_entity *entity)
 	return entity->vsp2->vspm->ip_par.par.vsp;
 }
 
-static void lut_configure(struct vsp2_entity *entity,
-			  struct vsp2_pipeline *pipe)
+static void lut_set_table(struct vsp2_lut *lut, int slot)
 {
-	struct vsp2_lut       *lut     = to_lut(&entity->subdev);
 	struct vsp_start_t    *vsp_par = to_vsp_par(&lut->entity);
 	struct vsp_lut_t      *vsp_lut = vsp_par->ctrl_par->lut;
+	struct vsp2_lut_config *config = &lut->config[slot];
+	struct vsp2_dmabuf    *dmabuf  = &lut->dmabuf[slot];
 
 	/* VSPM parameter */
 
+	if (dmabuf->dbuf) {
+		vsp_lut->lut.hard_addr  = (unsigned int)dmabuf->addr;
+		vsp_lut->lut.virt_addr  = dmabuf->vaddr;
+		goto done;
+	}
+
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
+	vsp_lut->lut.hard_addr  = (unsigned int)lut->buff_h[slot];
+	vsp_lut->lut.virt_addr  = (void *)lut->buff_v[slot];
+#else
+	if (lut->auto_slots & (1 << slot)) {
+		vsp_lut->lut.hard_addr  = (unsigned int)lut->auto_h[slot];
+		vsp_lut->lut.virt_addr  = lut->auto_v[slot];
+	} else if (lut->pin[slot]) {
+		vsp_lut->lut.hard_addr  = (unsigned int)lut->pin[slot]->addr;
+		vsp_lut->lut.virt_addr  = lut->pin[slot]->vaddr;
+	}
+#endif
 
-	if (!lut->buff_v) {
-		VSP2_PRINT_ALERT("%s() error!!<1>", __func__);
-		return;
+done:
+	vsp_lut->lut.tbl_num    = config->tbl_num;
+	vsp_lut->fxa            = config->fxa;
+	/*vsp_lut->connect      = 0;    set by vsp2_entity_route_setup() */
+}
+
+static void lut_configure(struct vsp2_entity *entity,
+			  struct vsp2_pipeline *pipe)
+{
+	struct vsp2_lut *lut = to_lut(&entity->subdev);
+	struct v4l2_mbus_framefmt *format;
+	unsigned long flags;
+
+	format = vsp2_entity_get_pad_format(&lut->entity, lut->entity.config,
+					    LUT_PAD_SINK);
+	lut->auto_code = format->code;
+	lut->auto_valid = false;
+
+	/* No job is in flight when the pipeline is configured, all slots are
+	 * idle.
+	 */
+	spin_lock_irqsave(&lut->slot_lock, flags);
+	if (lut->pending >= 0) {
+		lut->active = lut->pending;
+		lut->pending = -1;
+	}
+	lut->busy = 0;
+	lut_set_table(lut, lut->active);
+	spin_unlock_irqrestore(&lut->slot_lock, flags);
+}
+
+/*
+ * vsp2_lut_prepare - Select the table used by the next job
+ * @lut: the LUT
+ * @seq: sequence number of the job
+ *
+ * Switch to the table most recently set through VIDIOC_VSP2_LUT_CONFIG or
+ * VIDIOC_VSP2_LUT_DMABUF, if any, and record that the job uses it. Must be
+ * called with the pipeline irqlock held, right before the job is handed to
+ * VSPM.
+ */
+void vsp2_lut_prepare(struct vsp2_lut *lut, unsigned int seq)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lut->slot_lock, flags);
+
+	if (lut->pending >= 0) {
+		lut->active = lut->pending;
+		lut->pending = -1;
+		lut_set_table(lut, lut->active);
+	}
+
+	lut->busy |= 1 << lut->active;
+	lut->last_seq[lut->active] = seq;
+
+	spin_unlock_irqrestore(&lut->slot_lock, flags);
+}
+
+/* -----------------------------------------------------------------------------
+ * Automatic Table
+ */
+
+static u32 lut_auto_count(const u32 *histo, unsigned int num_bins,
+			  unsigned int bin)
+{
+	/* The 64 bins histograms of the three components are merged. */
+	if (num_bins == 64)
+		return histo[bin] + histo[64 + bin] + histo[128 + bin];
+
+	return histo[bin];
+}
+
+/* Accumulate the histogram over the table entries, return the total. */
+static u32 lut_auto_cdf(struct vsp2_lut *lut, const u32 *histo,
+			unsigned int num_bins)
+{
+	unsigned int ratio = LUT_AUTO_SIZE / num_bins;
+	u32 sum = 0;
+	u32 count;
+	unsigned int i;
+
+	for (i = 0; i < LUT_AUTO_SIZE; ++i) {
+		/* Spread each bin evenly over the levels it covers. */
+		count = lut_auto_count(histo, num_bins, i / ratio);
+		lut->auto_cdf[i] = sum + count * (i % ratio + 1) / ratio;
+
+		if (i % ratio == ratio - 1)
+			sum += count;
+	}
+
+	return sum;
+}
+
+static void lut_auto_curve(struct vsp2_lut *lut, unsigned int mode,
+			   const u32 *histo, unsigned int num_bins)
+{
+	unsigned int smooth = READ_ONCE(lut->auto_smooth);
+	unsigned int lo = 0;
+	unsigned int hi = LUT_AUTO_SIZE - 1;
+	u32 total;
+	u32 clip;
+	u32 target;
+	unsigned int i;
+
+	total = lut_auto_cdf(lut, histo, num_bins);
+
+	if (mode == VSP2_LUT_AUTO_STRETCH && total) {
+		clip = (u32)div_u64((u64)total * READ_ONCE(lut->auto_clip),
+				    1000);
+
+		while (lo < LUT_AUTO_SIZE - 1 && lut->auto_cdf[lo] <= clip)
+			lo++;
+		while (hi > 0 && lut->auto_cdf[hi - 1] >= total - clip)
+			hi--;
+	}
+
+	for (i = 0; i < LUT_AUTO_SIZE; ++i) {
+		/* Output levels are computed in 8.8 fixed point. */
+		if (!total || hi <= lo)
+			target = i << 8;
+		else if (mode == VSP2_LUT_AUTO_EQUALIZE)
+			target = (u32)div_u64((u64)lut->auto_cdf[i] *
+					      (255 << 8), total);
+		else if (i <= lo)
+			target = 0;
+		else if (i >= hi)
+			target = 255 << 8;
+		else
+			target = (i - lo) * (255 << 8) / (hi - lo);
+
+		if (lut->auto_valid)
+			target = (lut->auto_curve[i] * smooth +
+				  target * (16 - smooth)) / 16;
+
+		lut->auto_curve[i] = target;
 	}
-	if (copy_from_user(lut->buff_v,
-			   (void __user *)lut->config.addr,
-			   lut->config.tbl_num * 8))
-		VSP2_PRINT_ALERT("%s() error<2>!!", __func__);
 
-	vsp_lut->lut.hard_addr  = (unsigned int)lut->buff_h;
-	vsp_lut->lut.virt_addr  = (void *)lut->buff_v;
+	lut->auto_valid = true;
+}
+
+static u32 lut_auto_entry(struct vsp2_lut *lut, unsigned int i)
+{
+	u32 level = (lut->auto_curve[i] + 0x80) >> 8;
+
+	level = min_t(u32, level, 255);
+
+	/* Only the luminance, or value, is remapped in YUV and HSV. */
+	switch (lut->auto_code) {
+	case MEDIA_BUS_FMT_AYUV8_1X32:
+		return (i << 16) | (level << 8) | i;
+	case MEDIA_BUS_FMT_AHSV8888_1X32:
+		return (i << 16) | (i << 8) | level;
+	default:
+		return (level << 16) | (level << 8) | level;
+	}
+}
+
+/*
+ * vsp2_lut_feedback - Compute the table from the histogram of a frame
+ * @lut: the LUT
+ * @histo: histograms written by the HGO for the frame
+ * @num_bins: number of bins of each histogram, see vsp2_hgo_histogram()
+ *
+ * Compute the table of the policy selected with VSP2_CID_LUT_AUTO and publish
+ * it for the next job. The frame is skipped if no slot is idle. Must be
+ * called with the pipeline irqlock held, when the job is retired.
+ */
+void vsp2_lut_feedback(struct vsp2_lut *lut, const u32 *histo,
+		       unsigned int num_bins)
+{
+	unsigned int mode = READ_ONCE(lut->auto_mode);
+	u32 *table;
+	int slot;
+	unsigned int i;
+
+	if (mode == VSP2_LUT_AUTO_OFF)
+		return;
+
+	lut_auto_curve(lut, mode, histo, num_bins);
+
+	slot = lut_get_slot(lut, true);
+	if (slot < 0)
+		return;
+
+#ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
+	table = lut->buff_v[slot];
 #else
-	vsp_lut->lut.hard_addr  =
-		(unsigned int)vsp2_addr_uv2hd((unsigned long)lut->config.addr);
+	table = lut->auto_v[slot];
+#endif
+	if (!table) {
+		lut_put_slot(lut, slot);
+		return;
+	}
 
-	vsp_lut->lut.virt_addr  =
-		(void *)vsp2_addr_uv2kv((unsigned long)lut->config.addr);
+	/* The table is a list of register address and value pairs. */
+	for (i = 0; i < LUT_AUTO_SIZE; ++i) {
+		table[i * 2] = VI6_LUT_TABLE + i * 4;
+		table[i * 2 + 1] = lut_auto_entry(lut, i);
+	}
 
+	lut->config[slot].addr = NULL;
+	lut->config[slot].tbl_num = LUT_AUTO_SIZE;
+	lut->config[slot].fxa = lut->config[lut->active].fxa;
+	lut_publish_slot(lut, slot, true);
+}
+
+static void lut_destroy(struct vsp2_entity *entity)
+{
+	struct vsp2_lut *lut = to_lut(&entity->subdev);
+	unsigned int i;
+
+	for (i = 0; i < LUT_NUM_SLOTS; ++i) {
+		vsp2_dmabuf_unmap(&lut->dmabuf[i]);
+#ifndef USE_BUFFER /* TODO: delete USE_BUFFER */
+		if (lut->pin[i])
+			vsp2_addr_unpin(lut->entity.vsp2, lut->pin[i]);
+		if (lut->auto_v[i])
+			dma_free_coherent(lut->entity.vsp2->dev,
+					  LUT_AUTO_SIZE * 8, lut->auto_v[i],
+					  lut->auto_h[i]);
 #endif
-	vsp_lut->lut.tbl_num    = lut->config.tbl_num;
-	vsp_lut->fxa            = lut->config.fxa;
-	/*vsp_lut->connect      = 0;    set by vsp2_entity_route_setup() */
+	}
 }
 
 static const struct vsp2_entity_operations lut_entity_ops = {
+	.destroy = lut_destroy,
 	.configure = lut_configure,
 };
 
@@ -249,6 +730,7 @@ static const struct vsp2_entity_operations lut_entity_ops = {
 struct vsp2_lut *vsp2_lut_create(struct vsp2_device *vsp2)
 {
 	struct vsp2_lut *lut;
+	unsigned int i;
 	int ret;
 
 	lut = devm_kzalloc(vsp2->dev, sizeof(*lut), GFP_KERNEL);
@@ -263,10 +745,48 @@ struct vsp2_lut *vsp2_lut_create(struct vsp2_device *vsp2)
 	if (ret < 0)
 		return ERR_PTR(ret);
 
+	lut->entity.subdev.internal_ops = &vsp2_addr_internal_ops;
+
+	mutex_init(&lut->lock);
+	spin_lock_init(&lut->slot_lock);
+	lut->active = 0;
+	lut->pending = -1;
+
+	/* Initialize the control handler. */
+	v4l2_ctrl_handler_init(&lut->ctrls, 3);
+	v4l2_ctrl_new_custom(&lut->ctrls, &lut_auto_ctrl, NULL);
+	v4l2_ctrl_new_custom(&lut->ctrls, &lut_auto_clip_ctrl, NULL);
+	v4l2_ctrl_new_custom(&lut->ctrls, &lut_auto_smooth_ctrl, NULL);
+
+	lut->auto_clip = lut_auto_clip_ctrl.def;
+	lut->auto_smooth = lut_auto_smooth_ctrl.def;
+
+	lut->entity.subdev.ctrl_handler = &lut->ctrls;
+
+	if (lut->ctrls.error) {
+		dev_err(vsp2->dev, "lut: failed to initialize controls\n");
+		ret = lut->ctrls.error;
+		vsp2_entity_destroy(&lut->entity);
+		return ERR_PTR(ret);
+	}
+
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
-	lut->buff_v = dma_alloc_coherent(vsp2->dev,
-					 LUT_BUFF_SIZE, &lut->buff_h,
-					 GFP_KERNEL | GFP_DMA);
+	for (i = 0; i < LUT_NUM_SLOTS; ++i) {
+		lut->buff_v[i] = dma_alloc_coherent(vsp2->dev,
+						    LUT_BUFF_SIZE,
+						    &lut->buff_h[i],
+						    GFP_KERNEL);
+	}
+#else
+	/* The automatic tables are written by the driver in atomic context,
+	 * they can't use user memory.
+	 */
+	for (i = 0; i < LUT_NUM_SLOTS; ++i) {
+		lut->auto_v[i] = dma_alloc_coherent(vsp2->dev,
+						    LUT_AUTO_SIZE * 8,
+						    &lut->auto_h[i],
+						    GFP_KERNEL);
+	}
 #endif
 
 	return lut;
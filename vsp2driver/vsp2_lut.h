@@ -58,13 +58,20 @@
 #ifndef __VSP2_LUT_H__
 #define __VSP2_LUT_H__
 
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
 #include <media/media-entity.h>
+#include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 #include <linux/vsp2.h>
 
+#include "vsp2_addr.h"
+#include "vsp2_dmabuf.h"
 #include "vsp2_entity.h"
 
 struct vsp2_device;
+struct vsp2_pipeline;
 
 #define LUT_PAD_SINK				0
 #define LUT_PAD_SOURCE				1
@@ -73,19 +80,55 @@ struct vsp2_device;
 #define	LUT_BUFF_SIZE				(256 * 8)
 #endif
 
+/* Number of table slots. One slot is used by the jobs being submitted, the
+ * others receive new tables while the hardware may still read older ones.
+ */
+#define LUT_NUM_SLOTS				3
+
+/* Number of entries of the tables computed by the driver. */
+#define LUT_AUTO_SIZE				256
+
 struct vsp2_lut {
 	/* entitiy */
 
 	struct vsp2_entity		entity;
+	struct vsp2_pipeline		*pipe;
 
 	/* config */
 
-	struct vsp2_lut_config	config;
+	struct mutex			lock;	/* serializes table updates */
+	spinlock_t			slot_lock; /* protects the slot state */
+	struct vsp2_lut_config	config[LUT_NUM_SLOTS];
+	struct vsp2_dmabuf		dmabuf[LUT_NUM_SLOTS];
+	int				active;
+	int				pending;
+	unsigned int			busy;
+	unsigned int			writing;
+	unsigned int			last_seq[LUT_NUM_SLOTS];
+
+	/* automatic table */
+
+	struct v4l2_ctrl_handler	ctrls;
+	unsigned int			auto_mode;
+	unsigned int			auto_clip;
+	unsigned int			auto_smooth;
+	u32				auto_code;	/* sink format */
+	bool				auto_valid;	/* auto_curve is set */
+	u16				auto_curve[LUT_AUTO_SIZE]; /* 8.8 */
+	u32				auto_cdf[LUT_AUTO_SIZE];
 
 #ifdef USE_BUFFER /* TODO: delete USE_BUFFER */
 	/* buffer */
-	void					*buff_v;
-	dma_addr_t				buff_h;
+	void					*buff_v[LUT_NUM_SLOTS];
+	dma_addr_t				buff_h[LUT_NUM_SLOTS];
+#else
+	/* pinned user memory */
+	struct vsp2_addr_pin	*pin[LUT_NUM_SLOTS];
+
+	/* driver memory of the automatic tables */
+	void					*auto_v[LUT_NUM_SLOTS];
+	dma_addr_t				auto_h[LUT_NUM_SLOTS];
+	unsigned int			auto_slots;	/* slots using it */
 #endif
 };
 
@@ -95,5 +138,8 @@ static inline struct vsp2_lut *to_lut(struct v4l2_subdev *subdev)
 }
 
 struct vsp2_lut *vsp2_lut_create(struct vsp2_device *vsp2);
+void vsp2_lut_prepare(struct vsp2_lut *lut, unsigned int seq);
+void vsp2_lut_feedback(struct vsp2_lut *lut, const u32 *histo,
+		       unsigned int num_bins);
 
 #endif /* __VSP2_LUT_H__ */
@@ -64,7 +64,11 @@
 #include "vsp2_device.h"
 #include "vsp2_bru.h"
 #include "vsp2_brs.h"
+#include "vsp2_clu.h"
 #include "vsp2_entity.h"
+#include "vsp2_hgo.h"
+#include "vsp2_hgt.h"
+#include "vsp2_lut.h"
 #include "vsp2_pipe.h"
 #include "vsp2_rwpf.h"
 #include "vsp2_uds.h"
@@ -234,6 +238,21 @@ void vsp2_pipeline_reset(struct vsp2_pipeline *pipe)
 		pipe->output = NULL;
 	}
 
+	if (pipe->lut) {
+		to_lut(&pipe->lut->subdev)->pipe = NULL;
+		pipe->lut = NULL;
+	}
+
+	if (pipe->hgo) {
+		to_hgo(&pipe->hgo->subdev)->pipe = NULL;
+		pipe->hgo = NULL;
+	}
+
+	if (pipe->hgt) {
+		to_hgt(&pipe->hgt->subdev)->pipe = NULL;
+		pipe->hgt = NULL;
+	}
+
 	INIT_LIST_HEAD(&pipe->entities);
 	pipe->state = VSP2_PIPELINE_STOPPED;
 	pipe->buffers_ready = 0;
@@ -242,6 +261,11 @@ void vsp2_pipeline_reset(struct vsp2_pipeline *pipe)
 	pipe->bru = NULL;
 	pipe->brs = NULL;
 	pipe->uds = NULL;
+	pipe->sru = NULL;
+	pipe->clu = NULL;
+	pipe->split = false;
+	pipe->partial = false;
+	memset(&pipe->damage, 0, sizeof(pipe->damage));
 }
 
 void vsp2_pipeline_init(struct vsp2_pipeline *pipe)
@@ -255,14 +279,48 @@ void vsp2_pipeline_init(struct vsp2_pipeline *pipe)
 	pipe->state = VSP2_PIPELINE_STOPPED;
 }
 
-void vsp2_pipeline_run(struct vsp2_pipeline *pipe)
+/*
+ * vsp2_pipeline_run - Hand the next job of the pipeline to the VSPM
+ *
+ * Must be called with the pipeline irqlock held. A channel can be taken by a
+ * VIDIOC_VSP2_BRU_COMPOSE job after vsp2_pipeline_ready() returned true, the
+ * pipeline state is then left untouched and the job is retried with the same
+ * sequence number when the channel is released.
+ *
+ * Return 0 on success or -EBUSY if not enough channels are free.
+ */
+int vsp2_pipeline_run(struct vsp2_pipeline *pipe)
 {
 	struct vsp2_device *vsp2 = pipe->output->entity.vsp2;
+	const struct v4l2_rect *damage = NULL;
+	int ret;
+
+	if (pipe->partial && pipe->damage.width && pipe->damage.height)
+		damage = &pipe->damage;
+
+	if (pipe->lut)
+		vsp2_lut_prepare(to_lut(&pipe->lut->subdev),
+				 pipe->run_sequence);
+
+	if (pipe->clu)
+		vsp2_clu_prepare(to_clu(&pipe->clu->subdev));
 
-	vsp2_vspm_drv_entry(vsp2);
+	if (pipe->hgo)
+		vsp2_hgo_prepare(to_hgo(&pipe->hgo->subdev), pipe);
 
+	if (pipe->hgt)
+		vsp2_hgt_prepare(to_hgt(&pipe->hgt->subdev), pipe);
+
+	ret = vsp2_vspm_drv_entry(vsp2, pipe->run_sequence, pipe->split,
+				  damage);
+	if (ret < 0)
+		return ret;
+
+	pipe->run_sequence++;
 	pipe->state = VSP2_PIPELINE_RUNNING;
 	pipe->buffers_ready = 0;
+
+	return 0;
 }
 
 bool vsp2_pipeline_stopped(struct vsp2_pipeline *pipe)
@@ -296,16 +354,36 @@ int vsp2_pipeline_stop(struct vsp2_pipeline *pipe)
 	return ret;
 }
 
+/*
+ * vsp2_pipeline_ready - Check whether the pipeline can run a new job
+ *
+ * A job can be run when all video nodes have a buffer ready and a VSPM
+ * channel is free to process it. Several jobs can be in flight at the same
+ * time when multiple channels are available.
+ */
 bool vsp2_pipeline_ready(struct vsp2_pipeline *pipe)
 {
+	struct vsp2_device *vsp2 = pipe->output->entity.vsp2;
 	unsigned int mask;
 
-	mask = ((1 << pipe->num_inputs) - 1) << 1;
+	mask = ((1 << (pipe->num_video - 1)) - 1) << 1;
 	mask |= 1 << 0;
 
-	return pipe->buffers_ready == mask;
+	if (pipe->buffers_ready != mask)
+		return false;
+
+	if (pipe->state == VSP2_PIPELINE_STOPPING)
+		return false;
+
+	return vsp2_vspm_free_channels(vsp2) >= (pipe->split ? 2 : 1);
 }
 
+/*
+ * vsp2_pipeline_frame_end - Handle a job completion
+ *
+ * The frame end handler retires completed jobs in sequence order and updates
+ * the frame sequence number.
+ */
 void vsp2_pipeline_frame_end(struct vsp2_pipeline *pipe)
 {
 	if (!pipe)
@@ -313,8 +391,6 @@ void vsp2_pipeline_frame_end(struct vsp2_pipeline *pipe)
 
 	if (pipe->frame_end)
 		pipe->frame_end(pipe);
-
-	pipe->sequence++;
 }
 
 /*
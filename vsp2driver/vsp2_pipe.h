@@ -112,15 +112,24 @@ enum vsp2_pipeline_state {
  * @kref: pipeline reference count
  * @stream_count: number of streaming video nodes
  * @buffers_ready: bitmask of RPFs and WPFs with at least one buffer available
- * @sequence: frame sequence number
- * @num_video: number of video devices
- * @num_inputs: number of RPFs
+ * @sequence: sequence number of the next frame to complete
+ * @run_sequence: sequence number of the next job handed to the hardware
+ * @num_video: number of video devices, virtual RPFs excluded
+ * @num_inputs: number of RPFs, virtual RPFs included
  * @inputs: array of RPFs in the pipeline (indexed by RPF index)
  * @output: WPF at the output of the pipeline
  * @bru: BRU entity, if present
  * @brs: BRS entity, if present
  * @uds: UDS entity, if present
  * @uds_input: entity at the input of the UDS, if the UDS is present
+ * @sru: SRU entity, if present
+ * @lut: LUT entity, if present
+ * @clu: CLU entity, if present
+ * @hgo: HGO entity, if attached to the pipeline
+ * @hgt: HGT entity, if attached to the pipeline
+ * @split: frames are split in two halves processed on two VSPM channels
+ * @partial: jobs can be limited to the damaged area of the output
+ * @damage: damaged area of the next job, empty for the full frame
  * @entities: list of entities in the pipeline
  */
 struct vsp2_pipeline {
@@ -137,6 +146,7 @@ struct vsp2_pipeline {
 	unsigned int stream_count;
 	unsigned int buffers_ready;
 	unsigned int sequence;
+	unsigned int run_sequence;
 
 	unsigned int num_video;
 	unsigned int num_inputs;
@@ -146,6 +156,14 @@ struct vsp2_pipeline {
 	struct vsp2_entity *brs;
 	struct vsp2_entity *uds;
 	struct vsp2_entity *uds_input;
+	struct vsp2_entity *sru;
+	struct vsp2_entity *lut;
+	struct vsp2_entity *clu;
+	struct vsp2_entity *hgo;
+	struct vsp2_entity *hgt;
+	bool split;
+	bool partial;
+	struct v4l2_rect damage;
 
 	struct list_head entities;
 };
@@ -161,7 +179,7 @@ static inline struct vsp2_pipeline *to_vsp2_pipeline(struct media_entity *e)
 void vsp2_pipeline_reset(struct vsp2_pipeline *pipe);
 void vsp2_pipeline_init(struct vsp2_pipeline *pipe);
 
-void vsp2_pipeline_run(struct vsp2_pipeline *pipe);
+int vsp2_pipeline_run(struct vsp2_pipeline *pipe);
 bool vsp2_pipeline_stopped(struct vsp2_pipeline *pipe);
 int vsp2_pipeline_stop(struct vsp2_pipeline *pipe);
 bool vsp2_pipeline_ready(struct vsp2_pipeline *pipe);
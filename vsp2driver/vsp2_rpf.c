@@ -56,6 +56,7 @@
  */ /*************************************************************************/
 
 #include <linux/device.h>
+#include <linux/vsp2.h>
 
 #include <media/v4l2-subdev.h>
 
@@ -79,6 +80,135 @@ static struct vsp_src_t *rpf_get_vsp_in(struct vsp2_rwpf *rpf)
 	return vsp_par->src_par[rpf->entity.index];
 }
 
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+static int vsp2_rpf_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_rwpf *rpf = container_of(ctrl->handler,
+					     struct vsp2_rwpf, ctrls);
+	struct media_device *mdev = &rpf->entity.vsp2->media_dev;
+	int ret = 0;
+
+	switch (ctrl->id) {
+	case VSP2_CID_VIR:
+		mutex_lock(&mdev->graph_mutex);
+		if (rpf->entity.subdev.entity.pipe)
+			ret = -EBUSY;
+		else
+			rpf->vir = ctrl->val;
+		mutex_unlock(&mdev->graph_mutex);
+		break;
+	case VSP2_CID_VIR_COLOR:
+		rpf->vircolor = ctrl->val;
+		break;
+	case VSP2_CID_ZPOS:
+		rpf->zpos = ctrl->val;
+		break;
+	case VSP2_CID_CKEY:
+		rpf->ckey_mode = ctrl->val;
+		break;
+	case VSP2_CID_CKEY_COLOR:
+		memcpy(rpf->ckey, ctrl->p_new.p_u32, sizeof(rpf->ckey));
+		break;
+	case VSP2_CID_MULT:
+		rpf->mult_mode = ctrl->val;
+		break;
+	case VSP2_CID_CROP_FRAC:
+		memcpy(rpf->crop_frac, ctrl->p_new.p_u16,
+		       sizeof(rpf->crop_frac));
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+	return ret;
+}
+
+static const struct v4l2_ctrl_ops vsp2_rpf_ctrl_ops = {
+	.s_ctrl = vsp2_rpf_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config rpf_vir_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_VIR,
+	.name = "Virtual Input",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.min = 0,
+	.max = 1,
+	.step = 1,
+	.def = 0,
+};
+
+static const struct v4l2_ctrl_config rpf_vir_color_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_VIR_COLOR,
+	.name = "Virtual Input Color",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = 0xffffff,
+	.step = 1,
+	.def = 0,
+};
+
+static const struct v4l2_ctrl_config rpf_zpos_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_ZPOS,
+	.name = "Layer Z-Order",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = VSP2_COUNT_RPF - 1,
+	.step = 1,
+	.def = 0,
+};
+
+static const struct v4l2_ctrl_config rpf_ckey_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_CKEY,
+	.name = "Color Key Mode",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = VSP2_CKEY_OFF,
+	.max = VSP2_CKEY_RANGE,
+	.step = 1,
+	.def = VSP2_CKEY_OFF,
+};
+
+static const struct v4l2_ctrl_config rpf_ckey_color_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_CKEY_COLOR,
+	.name = "Color Key Colors",
+	.type = V4L2_CTRL_TYPE_U32,
+	.min = 0,
+	.max = 0xffffffff,
+	.step = 1,
+	.def = 0,
+	.dims = { 2 },
+};
+
+static const struct v4l2_ctrl_config rpf_mult_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_MULT,
+	.name = "Multiplication Mode",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = VSP2_MULT_AUTO,
+	.max = VSP2_MULT_PREMUL_RATIO,
+	.step = 1,
+	.def = VSP2_MULT_AUTO,
+};
+
+static const struct v4l2_ctrl_config rpf_crop_frac_ctrl = {
+	.ops = &vsp2_rpf_ctrl_ops,
+	.id = VSP2_CID_CROP_FRAC,
+	.name = "Crop Fraction",
+	.type = V4L2_CTRL_TYPE_U16,
+	.min = 0,
+	.max = 0xffff,
+	.step = 1,
+	.def = 0,
+	.dims = { 2 },
+};
+
 /* -----------------------------------------------------------------------------
  * V4L2 Subdevice Operations
  */
@@ -102,11 +232,114 @@ static void rpf_set_memory(struct vsp2_entity *entity)
 		return;
 	}
 
+	rpf->entity.vsp2->vspm->zpos[rpf->entity.index] = rpf->zpos;
+
+	/* A virtual RPF has no memory, pick up color changes instead. */
+	if (rpf->vir) {
+		vsp_in->addr = 0;
+		vsp_in->addr_c0 = 0;
+		vsp_in->addr_c1 = 0;
+		vsp_in->vircolor = (rpf->alpha << 24) | rpf->vircolor;
+		return;
+	}
+
 	vsp_in->addr = (unsigned int)rpf->mem.addr[0] + rpf->offsets[0];
 	vsp_in->addr_c0 = (unsigned int)rpf->mem.addr[1] + rpf->offsets[1];
 	vsp_in->addr_c1 = (unsigned int)rpf->mem.addr[2] + rpf->offsets[1];
 }
 
+/* VSPM has no named color key modes, it writes the mode as is to the
+ * VI6_RPF_CKEY_CTRL register (R-Car Gen3 hardware manual, RPF color key
+ * control register). SAPEn replaces the alpha of the pixels matching key
+ * color n, CV matches the range between the two colors instead. The first
+ * key color carries the alpha of the matching pixels in range mode.
+ */
+static const unsigned char rpf_ckey_modes[] = {
+	[VSP2_CKEY_OFF] = 0,
+	[VSP2_CKEY_COLOR] = VI6_RPF_CKEY_CTRL_SAPE1 | VI6_RPF_CKEY_CTRL_SAPE0,
+	[VSP2_CKEY_RANGE] = VI6_RPF_CKEY_CTRL_CV | VI6_RPF_CKEY_CTRL_SAPE0,
+};
+
+static struct vsp_ckey_unit_t *rpf_configure_ckey(struct vsp2_rwpf *rpf)
+{
+	struct vsp_ckey_unit_t *ckey =
+		&rpf->entity.vsp2->vspm->ckey[rpf->entity.index];
+
+	if (rpf->ckey_mode == VSP2_CKEY_OFF ||
+	    rpf->ckey_mode >= ARRAY_SIZE(rpf_ckey_modes))
+		return NULL;
+
+	ckey->mode = rpf_ckey_modes[rpf->ckey_mode];
+	ckey->color1 = rpf->ckey[0];
+	ckey->color2 = rpf->ckey[1];
+
+	return ckey;
+}
+
+static u32 rpf_mult_mode(struct vsp2_rwpf *rpf,
+			 const struct v4l2_mbus_framefmt *source_format)
+{
+	bool premul = rpf->format.flags & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA;
+
+	if (source_format->code == MEDIA_BUS_FMT_AYUV8_1X32)
+		return VI6_RPF_MULT_ALPHA_A_MMD_NONE
+		     | VI6_RPF_MULT_ALPHA_P_MMD_NONE;
+
+	switch (rpf->mult_mode) {
+	case VSP2_MULT_THROUGH:
+		return VI6_RPF_MULT_ALPHA_A_MMD_NONE
+		     | VI6_RPF_MULT_ALPHA_P_MMD_NONE;
+	case VSP2_MULT_RATIO:
+		return VI6_RPF_MULT_ALPHA_A_MMD_RATIO
+		     | VI6_RPF_MULT_ALPHA_P_MMD_NONE;
+	case VSP2_MULT_PREMUL:
+		return VI6_RPF_MULT_ALPHA_A_MMD_NONE
+		     | VI6_RPF_MULT_ALPHA_P_MMD_IMAGE;
+	case VSP2_MULT_PREMUL_RATIO:
+		return VI6_RPF_MULT_ALPHA_A_MMD_RATIO
+		     | VI6_RPF_MULT_ALPHA_P_MMD_BOTH;
+	default:
+		/* Scale the alpha by the ratio, and the colors as well when
+		 * they are premultiplied.
+		 */
+		return VI6_RPF_MULT_ALPHA_A_MMD_RATIO
+		     | (premul ? VI6_RPF_MULT_ALPHA_P_MMD_RATIO
+			       : VI6_RPF_MULT_ALPHA_P_MMD_NONE);
+	}
+}
+
+static void rpf_configure_mult(struct vsp2_rwpf *rpf,
+			       const struct v4l2_mbus_framefmt *source_format,
+			       struct vsp_mult_unit_t *mult)
+{
+	u32 mult_alpha = rpf_mult_mode(rpf, source_format);
+
+	/* The VSPM multiplication modes follow the VI6_RPF_MULT_ALPHA
+	 * layout, VSP_MULT_THROUGH and VSP_MULT_RATIO being 0 and 1.
+	 */
+	mult->a_mmd = (mult_alpha & (1 << 12)) >> 12;
+	mult->p_mmd = (mult_alpha & (3 << 8)) >> 8;
+	mult->ratio = mult_alpha & (VI6_RPF_MULT_ALPHA_A_MMD_RATIO |
+				    VI6_RPF_MULT_ALPHA_P_MMD_RATIO) ?
+		      rpf->alpha : 0;
+}
+
+bool vsp2_rpf_premultiplied(struct vsp2_rwpf *rpf)
+{
+	const struct v4l2_mbus_framefmt *source_format;
+
+	source_format = vsp2_entity_get_pad_format(&rpf->entity,
+						   rpf->entity.config,
+						   RWPF_PAD_SOURCE);
+
+	if (source_format->code != MEDIA_BUS_FMT_AYUV8_1X32 &&
+	    (rpf->mult_mode == VSP2_MULT_PREMUL ||
+	     rpf->mult_mode == VSP2_MULT_PREMUL_RATIO))
+		return true;
+
+	return rpf->format.flags & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA;
+}
+
 static void rpf_configure(struct vsp2_entity *entity,
 			  struct vsp2_pipeline *pipe)
 {
@@ -235,10 +468,12 @@ static void rpf_configure(struct vsp2_entity *entity,
 	vsp_in->y_position	= top;
 
 	vsp_in->pwd		= VSP_LAYER_CHILD;
-	vsp_in->vir		= VSP_NO_VIR;
-	vsp_in->vircolor	= 0;
+	vsp_in->vir		= rpf->vir ? VSP_VIR : VSP_NO_VIR;
+	vsp_in->vircolor	= rpf->vir ?
+				  (rpf->alpha << 24) | rpf->vircolor : 0;
 
-	switch (fmtinfo->fourcc) {
+	/* The virtual color has no alpha channel, use the fixed alpha. */
+	switch (rpf->vir ? 0 : fmtinfo->fourcc) {
 	case V4L2_PIX_FMT_ARGB555:
 		if (CONFIG_VIDEO_RENESAS_VSP_ALPHA_BIT_ARGB1555 == 0)
 			alph_sel = (2 << 28) | (1 << 18) |
@@ -272,20 +507,9 @@ static void rpf_configure(struct vsp2_entity *entity,
 	vsp_in->alpha->anum0 = (alph_sel & (0xff << 0)) >> 0;
 	vsp_in->alpha->anum1 = (alph_sel & (0xff << 8)) >> 8;
 	vsp_in->alpha->irop = NULL;
-	vsp_in->alpha->ckey = NULL;
+	vsp_in->alpha->ckey = rpf_configure_ckey(rpf);
 
-	if (source_format->code == MEDIA_BUS_FMT_AYUV8_1X32) {
-		vsp_in->alpha->mult->a_mmd = VSP_MULT_THROUGH;
-		vsp_in->alpha->mult->p_mmd = VSP_MULT_THROUGH;
-		vsp_in->alpha->mult->ratio = 0;
-	} else {
-		vsp_in->alpha->mult->a_mmd = VSP_MULT_RATIO;
-		if (rpf->format.flags & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA)
-			vsp_in->alpha->mult->p_mmd = VSP_MULT_RATIO;
-		else
-			vsp_in->alpha->mult->p_mmd = VSP_MULT_THROUGH;
-		vsp_in->alpha->mult->ratio = rpf->alpha;
-	}
+	rpf_configure_mult(rpf, source_format, vsp_in->alpha->mult);
 
 	/* Count rpf_num. */
 	rpf->entity.vsp2->vspm->ip_par.par.vsp->rpf_num++;
@@ -302,6 +526,7 @@ static const struct vsp2_entity_operations rpf_entity_ops = {
 
 struct vsp2_rwpf *vsp2_rpf_create(struct vsp2_device *vsp2, unsigned int index)
 {
+	struct v4l2_ctrl_config zpos_ctrl = rpf_zpos_ctrl;
 	struct vsp2_rwpf *rpf;
 	char name[6];
 	int ret;
@@ -330,6 +555,21 @@ struct vsp2_rwpf *vsp2_rpf_create(struct vsp2_device *vsp2, unsigned int index)
 			index);
 		goto error;
 	}
+	v4l2_ctrl_new_custom(&rpf->ctrls, &rpf_vir_ctrl, NULL);
+	v4l2_ctrl_new_custom(&rpf->ctrls, &rpf_vir_color_ctrl, NULL);
+	v4l2_ctrl_new_custom(&rpf->ctrls, &rpf_ckey_ctrl, NULL);
+	v4l2_ctrl_new_custom(&rpf->ctrls, &rpf_ckey_color_ctrl, NULL);
+	v4l2_ctrl_new_custom(&rpf->ctrls, &rpf_mult_ctrl, NULL);
+	v4l2_ctrl_new_custom(&rpf->ctrls, &rpf_crop_frac_ctrl, NULL);
+
+	/* Stack the layers by RPF index by default. */
+	zpos_ctrl.def = index;
+	rpf->zpos = index;
+	v4l2_ctrl_new_custom(&rpf->ctrls, &zpos_ctrl, NULL);
+	if (rpf->ctrls.error) {
+		ret = rpf->ctrls.error;
+		goto error;
+	}
 
 	return rpf;
 
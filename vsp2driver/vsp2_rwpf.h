@@ -115,6 +115,21 @@ struct vsp2_rwpf {
 	} rotinfo;
 
 	int csc_mode;
+
+	bool split;
+	struct v4l2_rect damage;
+
+	bool vir;
+	u32 vircolor;
+
+	unsigned int zpos;
+
+	unsigned int ckey_mode;
+	u32 ckey[2];
+
+	unsigned int mult_mode;
+
+	u16 crop_frac[2];
 };
 
 static inline struct vsp2_rwpf *to_rwpf(struct v4l2_subdev *subdev)
@@ -130,6 +145,8 @@ static inline struct vsp2_rwpf *entity_to_rwpf(struct vsp2_entity *entity)
 struct vsp2_rwpf *vsp2_rpf_create(struct vsp2_device *vsp2, unsigned int index);
 struct vsp2_rwpf *vsp2_wpf_create(struct vsp2_device *vsp2, unsigned int index);
 
+bool vsp2_rpf_premultiplied(struct vsp2_rwpf *rpf);
+
 int vsp2_rwpf_init_ctrls(struct vsp2_rwpf *rwpf);
 
 extern const struct v4l2_subdev_pad_ops vsp2_rwpf_pad_ops;
@@ -0,0 +1,298 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+#include <linux/device.h>
+#include <linux/gfp.h>
+#include <linux/vsp2.h>
+
+#include <media/v4l2-subdev.h>
+
+#include "vsp2_device.h"
+#include "vsp2_shp.h"
+#include "vsp2_vspm.h"
+
+#define SHP_MIN_SIZE				(1U)
+#define SHP_MAX_SIZE				(8190U)
+
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+static int shp_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_shp *shp =
+		container_of(ctrl->handler, struct vsp2_shp, ctrls);
+
+	switch (ctrl->id) {
+	case VSP2_CID_SHP_GAIN:
+		memcpy(shp->gain, ctrl->p_new.p_u8, sizeof(shp->gain));
+		break;
+	case VSP2_CID_SHP_CORING:
+		memcpy(shp->coring, ctrl->p_new.p_u8, sizeof(shp->coring));
+		break;
+	case VSP2_CID_SHP_LIMIT:
+		memcpy(shp->limit, ctrl->p_new.p_u8, sizeof(shp->limit));
+		break;
+	}
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops shp_ctrl_ops = {
+	.s_ctrl = shp_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config shp_gain_ctrl = {
+	.ops = &shp_ctrl_ops,
+	.id = VSP2_CID_SHP_GAIN,
+	.name = "Sharpness Gain",
+	.type = V4L2_CTRL_TYPE_U8,
+	.min = 0,
+	.max = 0xff,
+	.step = 1,
+	.def = 0,
+	.dims = { SHP_NUM_BANDS },
+};
+
+static const struct v4l2_ctrl_config shp_coring_ctrl = {
+	.ops = &shp_ctrl_ops,
+	.id = VSP2_CID_SHP_CORING,
+	.name = "Sharpness Coring",
+	.type = V4L2_CTRL_TYPE_U8,
+	.min = 0,
+	.max = 0xff,
+	.step = 1,
+	.def = 0,
+	.dims = { SHP_NUM_BANDS },
+};
+
+static const struct v4l2_ctrl_config shp_limit_ctrl = {
+	.ops = &shp_ctrl_ops,
+	.id = VSP2_CID_SHP_LIMIT,
+	.name = "Sharpness Limit",
+	.type = V4L2_CTRL_TYPE_U8,
+	.min = 0,
+	.max = 0xff,
+	.step = 1,
+	.def = 0xff,
+	.dims = { SHP_NUM_BANDS },
+};
+
+/* -----------------------------------------------------------------------------
+ * V4L2 Subdevice Pad Operations
+ */
+
+static int shp_enum_mbus_code(struct v4l2_subdev *subdev,
+			      struct v4l2_subdev_pad_config *cfg,
+			      struct v4l2_subdev_mbus_code_enum *code)
+{
+	static const unsigned int codes[] = {
+		MEDIA_BUS_FMT_AYUV8_1X32,
+	};
+
+	return vsp2_subdev_enum_mbus_code(subdev, cfg, code, codes,
+					  ARRAY_SIZE(codes));
+}
+
+static int shp_enum_frame_size(struct v4l2_subdev *subdev,
+			       struct v4l2_subdev_pad_config *cfg,
+			       struct v4l2_subdev_frame_size_enum *fse)
+{
+	return vsp2_subdev_enum_frame_size(subdev, cfg, fse, SHP_MIN_SIZE,
+					   SHP_MIN_SIZE, SHP_MAX_SIZE,
+					   SHP_MAX_SIZE);
+}
+
+static int shp_set_format(
+	struct v4l2_subdev *subdev, struct v4l2_subdev_pad_config *cfg,
+	struct v4l2_subdev_format *fmt)
+{
+	struct vsp2_shp *shp = to_shp(subdev);
+	struct v4l2_subdev_pad_config *config;
+	struct v4l2_mbus_framefmt *format;
+	int ret = 0;
+
+	mutex_lock(&shp->entity.lock);
+
+	config = vsp2_entity_get_pad_config(&shp->entity, cfg, fmt->which);
+	if (!config) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	/* The SHP enhances the luma component and only processes YUV. */
+	fmt->format.code = MEDIA_BUS_FMT_AYUV8_1X32;
+
+	format = vsp2_entity_get_pad_format(&shp->entity, config, fmt->pad);
+
+	if (fmt->pad == SHP_PAD_SOURCE) {
+		/* The SHP output format can't be modified. */
+		fmt->format = *format;
+		goto done;
+	}
+
+	format->code = fmt->format.code;
+
+	format->width = clamp_t(unsigned int, fmt->format.width,
+				SHP_MIN_SIZE, SHP_MAX_SIZE);
+	format->height = clamp_t(unsigned int, fmt->format.height,
+				 SHP_MIN_SIZE, SHP_MAX_SIZE);
+	format->field = V4L2_FIELD_NONE;
+	format->colorspace = V4L2_COLORSPACE_SRGB;
+
+	fmt->format = *format;
+
+	/* Propagate the format to the source pad. */
+	format = vsp2_entity_get_pad_format(&shp->entity, config,
+					    SHP_PAD_SOURCE);
+	*format = fmt->format;
+
+done:
+	mutex_unlock(&shp->entity.lock);
+	return ret;
+}
+
+/* -----------------------------------------------------------------------------
+ * V4L2 Subdevice Operations
+ */
+
+static const struct v4l2_subdev_pad_ops shp_pad_ops = {
+	.init_cfg = vsp2_entity_init_cfg,
+	.enum_mbus_code = shp_enum_mbus_code,
+	.enum_frame_size = shp_enum_frame_size,
+	.get_fmt = vsp2_subdev_get_pad_format,
+	.set_fmt = shp_set_format,
+};
+
+static const struct v4l2_subdev_ops shp_ops = {
+	.pad    = &shp_pad_ops,
+};
+
+/* -----------------------------------------------------------------------------
+ * VSP2 Entity Operations
+ */
+
+static void shp_configure(struct vsp2_entity *entity,
+			  struct vsp2_pipeline *pipe)
+{
+	struct vsp2_shp *shp = to_shp(&entity->subdev);
+	struct vsp_start_t *vsp_par =
+		shp->entity.vsp2->vspm->ip_par.par.vsp;
+	struct vsp_shp_t *vsp_shp = vsp_par->ctrl_par->shp;
+	unsigned int i;
+
+	/* Band 0 covers the high frequencies and band 1 the medium ones. A
+	 * null gain on both bands passes the image through.
+	 */
+	vsp_shp->mode = (shp->gain[0] || shp->gain[1]) ?
+			VSP_SHP_SHARP : VSP_SHP_THROUGH;
+
+	for (i = 0; i < SHP_NUM_BANDS; ++i) {
+		struct vsp_shp_ctrl_t *band =
+			i ? &vsp_shp->gain1 : &vsp_shp->gain0;
+
+		band->gain = shp->gain[i];
+		band->coring = shp->coring[i];
+		band->limit = shp->limit[i];
+	}
+	/*vsp_shp->connect      = 0;    set by vsp2_entity_route_setup() */
+}
+
+static const struct vsp2_entity_operations shp_entity_ops = {
+	.configure = shp_configure,
+};
+
+/* -----------------------------------------------------------------------------
+ * Initialization and Cleanup
+ */
+
+struct vsp2_shp *vsp2_shp_create(struct vsp2_device *vsp2)
+{
+	struct vsp2_shp *shp;
+	int ret;
+
+	shp = devm_kzalloc(vsp2->dev, sizeof(*shp), GFP_KERNEL);
+	if (!shp)
+		return ERR_PTR(-ENOMEM);
+
+	shp->entity.ops = &shp_entity_ops;
+	shp->entity.type = VSP2_ENTITY_SHP;
+
+	ret = vsp2_entity_init(vsp2, &shp->entity, "shp", 2, &shp_ops,
+			       MEDIA_ENT_F_V4L2_SUBDEV_UNKNOWN);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	/* Initialize the control handler. */
+	v4l2_ctrl_handler_init(&shp->ctrls, 3);
+	v4l2_ctrl_new_custom(&shp->ctrls, &shp_gain_ctrl, NULL);
+	v4l2_ctrl_new_custom(&shp->ctrls, &shp_coring_ctrl, NULL);
+	v4l2_ctrl_new_custom(&shp->ctrls, &shp_limit_ctrl, NULL);
+
+	memset(shp->limit, 0xff, sizeof(shp->limit));
+
+	shp->entity.subdev.ctrl_handler = &shp->ctrls;
+
+	if (shp->ctrls.error) {
+		dev_err(vsp2->dev, "shp: failed to initialize controls\n");
+		ret = shp->ctrls.error;
+		vsp2_entity_destroy(&shp->entity);
+		return ERR_PTR(ret);
+	}
+
+	return shp;
+}
@@ -0,0 +1,359 @@
+/*************************************************************************/ /*
+ * VSP2
+ *
+ * Copyright (C) 2015-2017 Renesas Electronics Corporation
+ *
+ * License        Dual MIT/GPLv2
+ *
+ * The contents of this file are subject to the MIT license as set out below.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * the GNU General Public License Version 2 ("GPL") in which case the provisions
+ * of GPL are applicable instead of those above.
+ *
+ * If you wish to allow use of your version of this file only under the terms of
+ * GPL, and not to allow others to use your version of this file under the terms
+ * of the MIT license, indicate your decision by deleting the provisions above
+ * and replace them with the notice and other provisions required by GPL as set
+ * out in the file called "GPL-COPYING" included in this distribution. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under the terms of either the MIT license or GPL.
+ *
+ * This License is also included in this distribution in the file called
+ * "MIT-COPYING".
+ *
+ * EXCEPT AS OTHERWISE STATED IN A NEGOTIATED AGREEMENT: (A) THE SOFTWARE IS
+ * PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT; AND (B) IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+ * IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GPLv2:
+ * If you wish to use this file under the terms of GPL, following terms are
+ * effective.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */ /*************************************************************************/
+
+#include <linux/device.h>
+#include <linux/gfp.h>
+#include <linux/vsp2.h>
+
+#include <media/v4l2-subdev.h>
+
+#include "vsp2_device.h"
+#include "vsp2_sru.h"
+#include "vsp2_vspm.h"
+
+#define SRU_MIN_SIZE				4U
+#define SRU_MAX_SIZE				8190U
+
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+/* VI6_SRU_CTRL0 parameters for each intensity level, weakest first. */
+static const u32 sru_params[] = {
+	0,
+	(4 << VI6_SRU_CTRL0_PARAM0_SHIFT) | (4 << VI6_SRU_CTRL0_PARAM1_SHIFT),
+	(8 << VI6_SRU_CTRL0_PARAM0_SHIFT) | (4 << VI6_SRU_CTRL0_PARAM1_SHIFT),
+	(16 << VI6_SRU_CTRL0_PARAM0_SHIFT) | (4 << VI6_SRU_CTRL0_PARAM1_SHIFT),
+	(16 << VI6_SRU_CTRL0_PARAM0_SHIFT) | (6 << VI6_SRU_CTRL0_PARAM1_SHIFT),
+	(16 << VI6_SRU_CTRL0_PARAM0_SHIFT) | (8 << VI6_SRU_CTRL0_PARAM1_SHIFT),
+};
+
+static int sru_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_sru *sru =
+		container_of(ctrl->handler, struct vsp2_sru, ctrls);
+
+	switch (ctrl->id) {
+	case VSP2_CID_SRU_INTENSITY:
+		sru->intensity = ctrl->val;
+		break;
+	}
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops sru_ctrl_ops = {
+	.s_ctrl = sru_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config sru_intensity_ctrl = {
+	.ops = &sru_ctrl_ops,
+	.id = VSP2_CID_SRU_INTENSITY,
+	.name = "Intensity",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 1,
+	.max = ARRAY_SIZE(sru_params),
+	.step = 1,
+	.def = 1,
+};
+
+/* -----------------------------------------------------------------------------
+ * V4L2 Subdevice Pad Operations
+ */
+
+static int sru_enum_mbus_code(struct v4l2_subdev *subdev,
+			      struct v4l2_subdev_pad_config *cfg,
+			      struct v4l2_subdev_mbus_code_enum *code)
+{
+	static const unsigned int codes[] = {
+		MEDIA_BUS_FMT_ARGB8888_1X32,
+		MEDIA_BUS_FMT_AYUV8_1X32,
+	};
+
+	return vsp2_subdev_enum_mbus_code(subdev, cfg, code, codes,
+					  ARRAY_SIZE(codes));
+}
+
+static int sru_enum_frame_size(struct v4l2_subdev *subdev,
+			       struct v4l2_subdev_pad_config *cfg,
+			       struct v4l2_subdev_frame_size_enum *fse)
+{
+	struct vsp2_sru *sru = to_sru(subdev);
+	struct v4l2_subdev_pad_config *config;
+	struct v4l2_mbus_framefmt *format;
+	int ret = 0;
+
+	config = vsp2_entity_get_pad_config(&sru->entity, cfg, fse->which);
+	if (!config)
+		return -EINVAL;
+
+	format = vsp2_entity_get_pad_format(&sru->entity, config,
+					    SRU_PAD_SINK);
+
+	mutex_lock(&sru->entity.lock);
+
+	if (fse->index || fse->code != format->code) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	if (fse->pad == SRU_PAD_SINK) {
+		fse->min_width = SRU_MIN_SIZE;
+		fse->max_width = SRU_MAX_SIZE;
+		fse->min_height = SRU_MIN_SIZE;
+		fse->max_height = SRU_MAX_SIZE;
+	} else {
+		fse->min_width = format->width;
+		fse->min_height = format->height;
+		if (format->width <= SRU_MAX_SIZE / 2 &&
+		    format->height <= SRU_MAX_SIZE / 2) {
+			fse->max_width = format->width * 2;
+			fse->max_height = format->height * 2;
+		} else {
+			fse->max_width = format->width;
+			fse->max_height = format->height;
+		}
+	}
+
+done:
+	mutex_unlock(&sru->entity.lock);
+	return ret;
+}
+
+static void sru_try_format(struct vsp2_sru *sru,
+			   struct v4l2_subdev_pad_config *config,
+			   unsigned int pad, struct v4l2_mbus_framefmt *fmt)
+{
+	struct v4l2_mbus_framefmt *format;
+	unsigned int input_area;
+	unsigned int output_area;
+
+	switch (pad) {
+	case SRU_PAD_SINK:
+		/* Default to YUV if the requested format is not supported. */
+		if (fmt->code != MEDIA_BUS_FMT_ARGB8888_1X32 &&
+		    fmt->code != MEDIA_BUS_FMT_AYUV8_1X32)
+			fmt->code = MEDIA_BUS_FMT_AYUV8_1X32;
+
+		fmt->width = clamp(fmt->width, SRU_MIN_SIZE, SRU_MAX_SIZE);
+		fmt->height = clamp(fmt->height, SRU_MIN_SIZE, SRU_MAX_SIZE);
+		break;
+
+	case SRU_PAD_SOURCE:
+		/* The SRU can't perform format conversion. */
+		format = vsp2_entity_get_pad_format(&sru->entity, config,
+						    SRU_PAD_SINK);
+		fmt->code = format->code;
+
+		/* We can upscale by 2 in both direction, but not
+		 * independently. Compare the input and output rectangles
+		 * areas (avoiding integer overflows on the output): if the
+		 * requested output area is larger than 1.5^2 the input area
+		 * upscale by two, otherwise don't scale.
+		 */
+		input_area = format->width * format->height;
+		output_area = min(fmt->width, SRU_MAX_SIZE)
+			    * min(fmt->height, SRU_MAX_SIZE);
+
+		if (format->width <= SRU_MAX_SIZE / 2 &&
+		    format->height <= SRU_MAX_SIZE / 2 &&
+		    output_area > input_area * 9 / 4) {
+			fmt->width = format->width * 2;
+			fmt->height = format->height * 2;
+		} else {
+			fmt->width = format->width;
+			fmt->height = format->height;
+		}
+		break;
+	}
+
+	fmt->field = V4L2_FIELD_NONE;
+	fmt->colorspace = V4L2_COLORSPACE_SRGB;
+}
+
+static int sru_set_format(
+	struct v4l2_subdev *subdev, struct v4l2_subdev_pad_config *cfg,
+	struct v4l2_subdev_format *fmt)
+{
+	struct vsp2_sru *sru = to_sru(subdev);
+	struct v4l2_subdev_pad_config *config;
+	struct v4l2_mbus_framefmt *format;
+	int ret = 0;
+
+	mutex_lock(&sru->entity.lock);
+
+	config = vsp2_entity_get_pad_config(&sru->entity, cfg, fmt->which);
+	if (!config) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	sru_try_format(sru, config, fmt->pad, &fmt->format);
+
+	format = vsp2_entity_get_pad_format(&sru->entity, config, fmt->pad);
+	*format = fmt->format;
+
+	if (fmt->pad == SRU_PAD_SINK) {
+		/* Propagate the format to the source pad. */
+		format = vsp2_entity_get_pad_format(&sru->entity, config,
+						    SRU_PAD_SOURCE);
+		*format = fmt->format;
+
+		sru_try_format(sru, config, SRU_PAD_SOURCE, format);
+	}
+
+done:
+	mutex_unlock(&sru->entity.lock);
+	return ret;
+}
+
+/* -----------------------------------------------------------------------------
+ * V4L2 Subdevice Operations
+ */
+
+static const struct v4l2_subdev_pad_ops sru_pad_ops = {
+	.init_cfg = vsp2_entity_init_cfg,
+	.enum_mbus_code = sru_enum_mbus_code,
+	.enum_frame_size = sru_enum_frame_size,
+	.get_fmt = vsp2_subdev_get_pad_format,
+	.set_fmt = sru_set_format,
+};
+
+static const struct v4l2_subdev_ops sru_ops = {
+	.pad    = &sru_pad_ops,
+};
+
+/* -----------------------------------------------------------------------------
+ * VSP2 Entity Operations
+ */
+
+static void sru_configure(struct vsp2_entity *entity,
+			  struct vsp2_pipeline *pipe)
+{
+	struct vsp2_sru *sru = to_sru(&entity->subdev);
+	const struct v4l2_mbus_framefmt *input;
+	const struct v4l2_mbus_framefmt *output;
+	struct vsp_start_t *vsp_par =
+		sru->entity.vsp2->vspm->ip_par.par.vsp;
+	struct vsp_sru_t *vsp_sru = vsp_par->ctrl_par->sru;
+	u32 ctrl0;
+
+	input = vsp2_entity_get_pad_format(&sru->entity, sru->entity.config,
+					   SRU_PAD_SINK);
+	output = vsp2_entity_get_pad_format(&sru->entity, sru->entity.config,
+					    SRU_PAD_SOURCE);
+
+	if (input->code == MEDIA_BUS_FMT_ARGB8888_1X32)
+		ctrl0 = VI6_SRU_CTRL0_PARAM2 | VI6_SRU_CTRL0_PARAM3
+		      | VI6_SRU_CTRL0_PARAM4;
+	else
+		ctrl0 = VI6_SRU_CTRL0_PARAM3;
+
+	ctrl0 |= sru_params[sru->intensity - 1];
+
+	/* The VSPM SRU parameter follows the VI6_SRU_CTRL0 layout, the mode
+	 * and enable bits being set by the VSPM.
+	 */
+	vsp_sru->mode = input->width != output->width ?
+			VSP_SRU_MODE2 : VSP_SRU_MODE1;
+	vsp_sru->param = ctrl0;
+	vsp_sru->enscl = VI6_SRU_CTRL1_PARAM5;
+	/*vsp_sru->connect      = 0;    set by vsp2_entity_route_setup() */
+}
+
+static const struct vsp2_entity_operations sru_entity_ops = {
+	.configure = sru_configure,
+};
+
+/* -----------------------------------------------------------------------------
+ * Initialization and Cleanup
+ */
+
+struct vsp2_sru *vsp2_sru_create(struct vsp2_device *vsp2)
+{
+	struct vsp2_sru *sru;
+	int ret;
+
+	sru = devm_kzalloc(vsp2->dev, sizeof(*sru), GFP_KERNEL);
+	if (!sru)
+		return ERR_PTR(-ENOMEM);
+
+	sru->entity.ops = &sru_entity_ops;
+	sru->entity.type = VSP2_ENTITY_SRU;
+
+	ret = vsp2_entity_init(vsp2, &sru->entity, "sru", 2, &sru_ops,
+			       MEDIA_ENT_F_PROC_VIDEO_SCALER);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	/* Initialize the control handler. */
+	v4l2_ctrl_handler_init(&sru->ctrls, 1);
+	v4l2_ctrl_new_custom(&sru->ctrls, &sru_intensity_ctrl, NULL);
+
+	sru->intensity = 1;
+
+	sru->entity.subdev.ctrl_handler = &sru->ctrls;
+
+	if (sru->ctrls.error) {
+		dev_err(vsp2->dev, "sru: failed to initialize controls\n");
+		ret = sru->ctrls.error;
+		vsp2_entity_destroy(&sru->entity);
+		return ERR_PTR(ret);
+	}
+
+	return sru;
+}
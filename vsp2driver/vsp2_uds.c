@@ -57,9 +57,12 @@
 
 #include <linux/device.h>
 #include <linux/gfp.h>
+#include <linux/math64.h>
 
 #include <media/v4l2-subdev.h>
 
+#include <linux/vsp2.h>
+
 #include "vsp2_device.h"
 #include "vsp2_uds.h"
 #include "vsp2_vspm.h"
@@ -72,6 +75,70 @@
 #define UDS_MIN_FACTOR				0x0100
 #define UDS_MAX_FACTOR				0xffff
 
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+static int uds_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vsp2_uds *uds =
+		container_of(ctrl->handler, struct vsp2_uds, ctrls);
+
+	switch (ctrl->id) {
+	case VSP2_CID_UDS_FILTER:
+		uds->filter = ctrl->val;
+		break;
+	case VSP2_CID_UDS_CLIP:
+		uds->clip = ctrl->val;
+		break;
+	case VSP2_CID_UDS_ALPHA_THRES:
+		memcpy(uds->athres, ctrl->p_new.p_u8, sizeof(uds->athres));
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops uds_ctrl_ops = {
+	.s_ctrl = uds_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config uds_filter_ctrl = {
+	.ops = &uds_ctrl_ops,
+	.id = VSP2_CID_UDS_FILTER,
+	.name = "Scaling Filter",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = VSP2_UDS_FILTER_AUTO,
+	.max = VSP2_UDS_FILTER_MULTITAP,
+	.step = 1,
+	.def = VSP2_UDS_FILTER_AUTO,
+};
+
+static const struct v4l2_ctrl_config uds_clip_ctrl = {
+	.ops = &uds_ctrl_ops,
+	.id = VSP2_CID_UDS_CLIP,
+	.name = "Scaling Clipping",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.min = 0,
+	.max = 1,
+	.step = 1,
+	.def = 0,
+};
+
+static const struct v4l2_ctrl_config uds_athres_ctrl = {
+	.ops = &uds_ctrl_ops,
+	.id = VSP2_CID_UDS_ALPHA_THRES,
+	.name = "Alpha Thresholds",
+	.type = V4L2_CTRL_TYPE_U8,
+	.min = 0,
+	.max = 0xff,
+	.step = 1,
+	.def = 0,
+	.dims = { 2 },
+};
+
 /* -----------------------------------------------------------------------------
  * Scaling Computation
  */
@@ -125,9 +192,18 @@ static void uds_output_limits(unsigned int input,
 		       UDS_OUT_MAX_SIZE);
 }
 
-static unsigned int uds_compute_ratio(unsigned int input, unsigned int output)
+/*
+ * uds_compute_ratio - Return the scaling ratio in U4.12 fixed-point format
+ * @input: input size in pixels
+ * @frac: fractional part of the input size in 1/65536 pixel units
+ * @output: output size in pixels
+ */
+static unsigned int uds_compute_ratio(unsigned int input, unsigned int frac,
+				      unsigned int output)
 {
-	return input * 4096 / output;
+	u64 size = ((u64)input << 16) + frac;
+
+	return div_u64(size * 4096, output) >> 16;
 }
 
 int vsp2_uds_check_ratio(struct vsp2_entity *entity)
@@ -143,8 +219,10 @@ int vsp2_uds_check_ratio(struct vsp2_entity *entity)
 	output = vsp2_entity_get_pad_format(&uds->entity, uds->entity.config,
 					    UDS_PAD_SOURCE);
 
-	hscale = uds_compute_ratio(input->width, output->width);
-	vscale = uds_compute_ratio(input->height, output->height);
+	hscale = uds_compute_ratio(input->width, uds->crop_frac[0],
+				   output->width);
+	vscale = uds_compute_ratio(input->height, uds->crop_frac[1],
+				   output->height);
 	if (hscale < 0x100 || hscale > 0xffff)
 		return -EINVAL;
 	if (vscale < 0x100 || vscale > 0xffff)
@@ -312,7 +390,7 @@ static void uds_configure(struct vsp2_entity *entity,
 	const struct v4l2_mbus_framefmt *input;
 	unsigned int hscale;
 	unsigned int vscale;
-	bool multitap;
+	unsigned char complement;
 	struct vsp_start_t *vsp_par =
 		uds->entity.vsp2->vspm->ip_par.par.vsp;
 	struct vsp_uds_t *vsp_uds = vsp_par->ctrl_par->uds;
@@ -322,29 +400,41 @@ static void uds_configure(struct vsp2_entity *entity,
 	output = vsp2_entity_get_pad_format(&uds->entity, uds->entity.config,
 					    UDS_PAD_SOURCE);
 
-	hscale = uds_compute_ratio(input->width, output->width);
-	vscale = uds_compute_ratio(input->height, output->height);
+	hscale = uds_compute_ratio(input->width, uds->crop_frac[0],
+				   output->width);
+	vscale = uds_compute_ratio(input->height, uds->crop_frac[1],
+				   output->height);
 
 	dev_dbg(uds->entity.vsp2->dev, "hscale %u vscale %u\n", hscale, vscale);
 
-	/* Multi-tap scaling can't be enabled along with alpha scaling.
+	/* Multi-tap scaling can't be enabled along with alpha scaling, fall
+	 * back to bilinear interpolation in that case.
 	 */
-	if (uds->scale_alpha)
-		multitap = false;
-	else
-		multitap = true;
+	switch (uds->filter) {
+	case VSP2_UDS_FILTER_BILINEAR:
+		complement = VSP_COMPLEMENT_BIL;
+		break;
+	case VSP2_UDS_FILTER_NEAREST:
+		complement = VSP_COMPLEMENT_NN;
+		break;
+	case VSP2_UDS_FILTER_MULTITAP:
+	default:
+		complement = uds->scale_alpha ?
+			     VSP_COMPLEMENT_BIL : VSP_COMPLEMENT_BC;
+		break;
+	}
 
 	vsp_uds->amd = VSP_AMD;
-	vsp_uds->clip = VSP_CLIP_OFF;
+	vsp_uds->clip = uds->clip ? VSP_CLIP_ON : VSP_CLIP_OFF;
 	vsp_uds->alpha = uds->scale_alpha ? VSP_ALPHA_ON : VSP_ALPHA_OFF;
-	vsp_uds->complement = multitap ? VSP_COMPLEMENT_BC : VSP_COMPLEMENT_BIL;
+	vsp_uds->complement = complement;
 
 	/* Set the scaling ratios and the output size. */
 	vsp_uds->x_ratio	= hscale;
 	vsp_uds->y_ratio	= vscale;
 
-	vsp_uds->athres0	= 0;
-	vsp_uds->athres1	= 0;
+	vsp_uds->athres0	= uds->athres[0];
+	vsp_uds->athres1	= uds->athres[1];
 }
 
 static const struct vsp2_entity_operations uds_entity_ops = {
@@ -375,5 +465,21 @@ struct vsp2_uds *vsp2_uds_create(struct vsp2_device *vsp2, unsigned int index)
 	if (ret < 0)
 		return ERR_PTR(ret);
 
+	/* Initialize the control handler. */
+	v4l2_ctrl_handler_init(&uds->ctrls, 3);
+	v4l2_ctrl_new_custom(&uds->ctrls, &uds_filter_ctrl, NULL);
+	v4l2_ctrl_new_custom(&uds->ctrls, &uds_clip_ctrl, NULL);
+	v4l2_ctrl_new_custom(&uds->ctrls, &uds_athres_ctrl, NULL);
+
+	uds->entity.subdev.ctrl_handler = &uds->ctrls;
+
+	if (uds->ctrls.error) {
+		dev_err(vsp2->dev, "uds%u: failed to initialize controls\n",
+			index);
+		ret = uds->ctrls.error;
+		vsp2_entity_destroy(&uds->entity);
+		return ERR_PTR(ret);
+	}
+
 	return uds;
 }
@@ -59,6 +59,7 @@
 #define __VSP2_UDS_H__
 
 #include <media/media-entity.h>
+#include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 
 #include "vsp2_entity.h"
@@ -71,6 +72,13 @@ struct vsp2_device;
 struct vsp2_uds {
 	struct vsp2_entity entity;
 	bool scale_alpha;
+
+	struct v4l2_ctrl_handler ctrls;
+	unsigned int filter;
+	bool clip;
+	u8 athres[2];
+
+	u32 crop_frac[2];
 };
 
 static inline struct vsp2_uds *to_uds(struct v4l2_subdev *subdev)
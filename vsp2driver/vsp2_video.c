@@ -76,7 +76,10 @@
 #include "vsp2_device.h"
 #include "vsp2_bru.h"
 #include "vsp2_brs.h"
+#include "vsp2_clu.h"
+#include "vsp2_compose.h"
 #include "vsp2_entity.h"
+#include "vsp2_lut.h"
 #include "vsp2_pipe.h"
 #include "vsp2_rwpf.h"
 #include "vsp2_uds.h"
@@ -84,6 +87,7 @@
 #include "vsp2_hgt.h"
 #include "vsp2_video.h"
 #include "vsp2_vspm.h"
+#include "vsp2_addr.h"
 #include "vsp2_debug.h"
 
 #define VSP2_VIDEO_DEF_FORMAT		V4L2_PIX_FMT_YUYV
@@ -377,18 +381,12 @@ static int vsp2_determine_csc_mode(struct vsp2_pipeline *pipe)
  * This function completes the current buffer by filling its sequence number,
  * time stamp and payload size, and hands it back to the videobuf core.
  *
- * When operating in DU output mode (deep pipeline to the DU through the LIF),
- * the VSP2 needs to constantly supply frames to the display. In that case, if
- * no other buffer is queued, reuse the one that has just been processed instead
- * of handing it back to the videobuf core.
- *
- * Return the next queued buffer or NULL if the queue is empty.
+ * The current buffer is the oldest buffer handed to the hardware, jobs being
+ * retired in order.
  */
-static struct vsp2_vb2_buffer *
-vsp2_video_complete_buffer(struct vsp2_video *video)
+static void vsp2_video_complete_buffer(struct vsp2_video *video)
 {
 	struct vsp2_pipeline *pipe = video->rwpf->pipe;
-	struct vsp2_vb2_buffer *next = NULL;
 	struct vsp2_vb2_buffer *done;
 	unsigned long flags;
 	unsigned int i;
@@ -397,7 +395,7 @@ vsp2_video_complete_buffer(struct vsp2_video *video)
 
 	if (list_empty(&video->irqqueue)) {
 		spin_unlock_irqrestore(&video->irqlock, flags);
-		return NULL;
+		return;
 	}
 
 	done = list_first_entry(&video->irqqueue,
@@ -405,10 +403,6 @@ vsp2_video_complete_buffer(struct vsp2_video *video)
 
 	list_del(&done->queue);
 
-	if (!list_empty(&video->irqqueue))
-		next = list_first_entry(&video->irqqueue,
-					struct vsp2_vb2_buffer, queue);
-
 	spin_unlock_irqrestore(&video->irqlock, flags);
 
 	done->buf.sequence = pipe->sequence;
@@ -417,25 +411,44 @@ vsp2_video_complete_buffer(struct vsp2_video *video)
 		vb2_set_plane_payload(&done->buf.vb2_buf, i,
 				      vb2_plane_size(&done->buf.vb2_buf, i));
 	vb2_buffer_done(&done->buf.vb2_buf, VB2_BUF_STATE_DONE);
-
-	return next;
 }
 
-static void vsp2_video_frame_end(struct vsp2_pipeline *pipe,
-				 struct vsp2_rwpf *rwpf)
+/*
+ * vsp2_video_prepare_buffer - Prepare the next buffer for the hardware
+ * @pipe: the pipeline
+ * @rwpf: the RPF or WPF of the video node
+ *
+ * Select the oldest queued buffer not handed to the hardware yet as the memory
+ * for the next job, and mark the video node as ready.
+ */
+static void vsp2_video_prepare_buffer(struct vsp2_pipeline *pipe,
+				      struct vsp2_rwpf *rwpf)
 {
 	struct vsp2_video *video = rwpf->video;
 	struct vsp2_vb2_buffer *buf;
+	unsigned long flags;
 
-	buf = vsp2_video_complete_buffer(video);
-	if (!buf)
+	if (pipe->buffers_ready & (1 << video->pipe_index))
 		return;
 
-	video->rwpf->mem = buf->mem;
-	pipe->buffers_ready |= 1 << video->pipe_index;
+	spin_lock_irqsave(&video->irqlock, flags);
+
+	list_for_each_entry(buf, &video->irqqueue, queue) {
+		if (buf->active)
+			continue;
+
+		buf->active = true;
+		rwpf->mem = buf->mem;
+		if (rwpf == pipe->output)
+			pipe->damage = buf->damage;
+		pipe->buffers_ready |= 1 << video->pipe_index;
+		break;
+	}
+
+	spin_unlock_irqrestore(&video->irqlock, flags);
 }
 
-static void vsp2_video_pipeline_run(struct vsp2_pipeline *pipe)
+static int vsp2_video_pipeline_run(struct vsp2_pipeline *pipe)
 {
 	struct vsp2_device *vsp2 = pipe->output->entity.vsp2;
 	unsigned int i;
@@ -449,38 +462,99 @@ static void vsp2_video_pipeline_run(struct vsp2_pipeline *pipe)
 
 	vsp2_rwpf_set_memory(pipe->output);
 
-	vsp2_pipeline_run(pipe);
+	return vsp2_pipeline_run(pipe);
+}
+
+/*
+ * vsp2_video_pipeline_schedule - Run as many jobs as possible
+ * @pipe: the pipeline
+ *
+ * Must be called with the pipeline irqlock held.
+ */
+static void vsp2_video_pipeline_schedule(struct vsp2_pipeline *pipe)
+{
+	struct vsp2_device *vsp2 = pipe->output->entity.vsp2;
+	unsigned int i;
+
+	while (1) {
+		for (i = 0; i < vsp2->pdata.rpf_count; ++i) {
+			if (pipe->inputs[i] && !pipe->inputs[i]->vir)
+				vsp2_video_prepare_buffer(pipe,
+							  pipe->inputs[i]);
+		}
+
+		vsp2_video_prepare_buffer(pipe, pipe->output);
+
+		if (!vsp2_pipeline_ready(pipe))
+			break;
+
+		if (vsp2_video_pipeline_run(pipe) < 0)
+			break;
+	}
 }
 
 static void vsp2_video_pipeline_frame_end(struct vsp2_pipeline *pipe)
 {
 	struct vsp2_device *vsp2 = pipe->output->entity.vsp2;
+	struct vsp2_hgo *hgo = pipe->hgo ? to_hgo(&pipe->hgo->subdev) : NULL;
+	struct vsp2_hgt *hgt = pipe->hgt ? to_hgt(&pipe->hgt->subdev) : NULL;
 	enum vsp2_pipeline_state state;
+	unsigned int num_bins;
+	const u32 *histo;
 	unsigned long flags;
 	unsigned int i;
 
 	spin_lock_irqsave(&pipe->irqlock, flags);
 
-	/* Complete buffers on all video nodes. */
-	for (i = 0; i < vsp2->pdata.rpf_count; ++i) {
-		if (!pipe->inputs[i])
-			continue;
+	/* Jobs can complete out of order when several VSPM channels are used,
+	 * retire them in sequence order and complete buffers on all video
+	 * nodes for each of them.
+	 */
+	while (vsp2_vspm_job_retire(vsp2, pipe->sequence)) {
+		for (i = 0; i < vsp2->pdata.rpf_count; ++i) {
+			if (!pipe->inputs[i] || pipe->inputs[i]->vir)
+				continue;
 
-		vsp2_video_frame_end(pipe, pipe->inputs[i]);
-	}
+			vsp2_video_complete_buffer(pipe->inputs[i]->video);
+		}
+
+		vsp2_video_complete_buffer(pipe->output->video);
 
-	vsp2_video_frame_end(pipe, pipe->output);
+		/* Feed the histogram back to the LUT for the next jobs. */
+		if (pipe->lut && pipe->hgo) {
+			histo = vsp2_hgo_histogram(hgo, pipe, pipe->sequence,
+						   &num_bins);
+			if (histo)
+				vsp2_lut_feedback(to_lut(&pipe->lut->subdev),
+						  histo, num_bins);
+		}
+
+		if (pipe->hgo)
+			vsp2_histogram_buffer_complete(&hgo->histo,
+						       pipe, pipe->sequence);
+
+		if (pipe->hgt)
+			vsp2_histogram_buffer_complete(&hgt->histo,
+						       pipe, pipe->sequence);
+
+		pipe->sequence++;
+	}
 
 	state = pipe->state;
-	pipe->state = VSP2_PIPELINE_STOPPED;
+
+	/* The pipeline is stopped once no job is in flight anymore. */
+	if (pipe->sequence == pipe->run_sequence)
+		pipe->state = VSP2_PIPELINE_STOPPED;
 
 	/* If a stop has been requested, mark the pipeline as stopped and
-	 * return. Otherwise restart the pipeline if ready.
+	 * return. Otherwise run new jobs if ready.
 	 */
-	if (state == VSP2_PIPELINE_STOPPING)
-		wake_up(&pipe->wq);
-	else if (vsp2_pipeline_ready(pipe))
-		vsp2_video_pipeline_run(pipe);
+	if (state == VSP2_PIPELINE_STOPPING) {
+		if (pipe->state == VSP2_PIPELINE_STOPPED)
+			wake_up(&pipe->wq);
+	} else {
+		vsp2_video_pipeline_schedule(pipe);
+	}
 
 	spin_unlock_irqrestore(&pipe->irqlock, flags);
 }
@@ -583,6 +657,7 @@ static int vsp2_video_pipeline_build(struct vsp2_pipeline *pipe,
 	struct media_graph graph;
 	struct media_entity *entity = &video->video.entity;
 	struct media_device *mdev = entity->graph_obj.mdev;
+	unsigned int num_buffers = 0;
 	unsigned int i;
 	int ret;
 
@@ -599,7 +674,12 @@ static int vsp2_video_pipeline_build(struct vsp2_pipeline *pipe,
 		struct vsp2_entity *e;
 
 		if (!is_media_entity_v4l2_subdev(entity)) {
-			pipe->num_video++;
+			struct video_device *vdev =
+				media_entity_to_video_device(entity);
+
+			/* Virtual RPFs don't use their video node. */
+			if (!to_vsp2_video(vdev)->rwpf->vir)
+				pipe->num_video++;
 			continue;
 		}
 
@@ -610,7 +690,9 @@ static int vsp2_video_pipeline_build(struct vsp2_pipeline *pipe,
 		if (e->type == VSP2_ENTITY_RPF) {
 			rwpf = to_rwpf(subdev);
 			pipe->inputs[rwpf->entity.index] = rwpf;
-			rwpf->video->pipe_index = ++pipe->num_inputs;
+			pipe->num_inputs++;
+			if (!rwpf->vir)
+				rwpf->video->pipe_index = ++num_buffers;
 			rwpf->pipe = pipe;
 		} else if (e->type == VSP2_ENTITY_WPF) {
 			rwpf = to_rwpf(subdev);
@@ -621,6 +703,13 @@ static int vsp2_video_pipeline_build(struct vsp2_pipeline *pipe,
 			pipe->bru = e;
 		} else if (e->type == VSP2_ENTITY_BRS) {
 			pipe->brs = e;
+		} else if (e->type == VSP2_ENTITY_SRU) {
+			pipe->sru = e;
+		} else if (e->type == VSP2_ENTITY_LUT) {
+			pipe->lut = e;
+			to_lut(subdev)->pipe = pipe;
+		} else if (e->type == VSP2_ENTITY_CLU) {
+			pipe->clu = e;
 		}
 	}
 
@@ -769,6 +858,10 @@ static int vsp2_video_buffer_prepare(struct vb2_buffer *vb)
 
 		if (vb2_plane_size(vb, i) < format->plane_fmt[i].sizeimage)
 			return -EINVAL;
+
+		if (vsp2_addr_check(video->vsp2, buf->mem.addr[i],
+				    format->plane_fmt[i].sizeimage) < 0)
+			return -EINVAL;
 	}
 
 	for ( ; i < 3; ++i)
@@ -784,24 +877,20 @@ static void vsp2_video_buffer_queue(struct vb2_buffer *vb)
 	struct vsp2_pipeline *pipe = video->rwpf->pipe;
 	struct vsp2_vb2_buffer *buf = to_vsp2_vb2_buffer(vbuf);
 	unsigned long flags;
-	bool empty;
+
+	buf->active = false;
 
 	spin_lock_irqsave(&video->irqlock, flags);
-	empty = list_empty(&video->irqqueue);
+	buf->damage = video->rwpf->damage;
 	list_add_tail(&buf->queue, &video->irqqueue);
 	spin_unlock_irqrestore(&video->irqlock, flags);
 
-	if (!empty)
-		return;
-
 	spin_lock_irqsave(&pipe->irqlock, flags);
 
-	video->rwpf->mem = buf->mem;
-	pipe->buffers_ready |= 1 << video->pipe_index;
-
-	if (vb2_is_streaming(&video->queue) &&
-	    vsp2_pipeline_ready(pipe))
-		vsp2_video_pipeline_run(pipe);
+	if (vb2_is_streaming(&video->queue))
+		vsp2_video_pipeline_schedule(pipe);
+	else
+		vsp2_video_prepare_buffer(pipe, video->rwpf);
 
 	spin_unlock_irqrestore(&pipe->irqlock, flags);
 }
@@ -846,14 +935,55 @@ static int vsp2_video_setup_pipeline(struct vsp2_pipeline *pipe,
 		if (pipe->uds_input->type == VSP2_ENTITY_BRU ||
 		    pipe->uds_input->type == VSP2_ENTITY_BRS) {
 			uds->scale_alpha = false;
+			memset(uds->crop_frac, 0, sizeof(uds->crop_frac));
 		} else {
 			struct vsp2_rwpf *rpf =
 				to_rwpf(&pipe->uds_input->subdev);
+			const struct v4l2_mbus_framefmt *crop;
+			const struct v4l2_mbus_framefmt *sink;
 
 			uds->scale_alpha = rpf->fmtinfo->alpha;
+
+			/* Scale the crop fractions by the resizing of the
+			 * entities between the RPF and the UDS, such as a 2x
+			 * SRU, to express them in UDS input pixels.
+			 */
+			crop = vsp2_entity_get_pad_format(&rpf->entity,
+							  rpf->entity.config,
+							  RWPF_PAD_SOURCE);
+			sink = vsp2_entity_get_pad_format(pipe->uds,
+							  pipe->uds->config,
+							  UDS_PAD_SINK);
+			uds->crop_frac[0] = rpf->crop_frac[0] * sink->width /
+					    crop->width;
+			uds->crop_frac[1] = rpf->crop_frac[1] * sink->height /
+					    crop->height;
 		}
 	}
 
+	/* Split mode processes the left and right halves of the frame on two
+	 * channels. Only a single input scaled straight to the output by the
+	 * UDS can be partitioned that way.
+	 */
+	pipe->split = pipe->output->split;
+	if (pipe->split) {
+		if (pipe->bru || pipe->brs || pipe->sru ||
+		    pipe->num_inputs != 1 ||
+		    pipe->output->rotinfo.rotation != VSP_ROT_OFF ||
+		    video->vsp2->vspm->ch_count < 2) {
+			dev_err(video->vsp2->dev,
+				"split mode not supported by the pipeline\n");
+			return -EINVAL;
+		}
+	}
+
+	/* Damage rectangles map directly to the BRU or BRS composition area,
+	 * they are ignored when the area is scaled or rotated.
+	 */
+	pipe->partial = (pipe->bru || pipe->brs) && !pipe->uds &&
+			!pipe->sru &&
+			pipe->output->rotinfo.rotation == VSP_ROT_OFF;
+
 	if (vsp2_determine_csc_mode(pipe) < 0)
 		VSP2_PRINT_ALERT("CSC mode is wrong. Use default.");
 
@@ -892,20 +1022,52 @@ static int vsp2_video_setup_pipeline(struct vsp2_pipeline *pipe,
 
 	/* control entity setup -> set vspm params */
 
-	/* - HGO */
+	/* - HGO, attached to the first pipeline started while configured */
 
-	entity = &video->vsp2->hgo->entity;
-	if (entity) {
-		if (entity->ops->configure)
-			entity->ops->configure(entity, pipe);
+	if (video->vsp2->hgo) {
+		struct vsp2_hgo *hgo = video->vsp2->hgo;
+		struct media_device *mdev = &video->vsp2->media_dev;
+
+		entity = &hgo->entity;
+
+		mutex_lock(&mdev->graph_mutex);
+		if (!hgo->pipe || hgo->pipe == pipe) {
+			if (entity->ops->configure)
+				entity->ops->configure(entity, pipe);
+
+			if (hgo->enabled && !hgo->pipe) {
+				hgo->pipe = pipe;
+				pipe->hgo = entity;
+			}
+		}
+		mutex_unlock(&mdev->graph_mutex);
 	}
 
-	/* - HGT */
+	/* - HGT, attached to the first pipeline started while configured */
 
-	entity = &video->vsp2->hgt->entity;
-	if (entity) {
-		if (entity->ops->configure)
-			entity->ops->configure(entity, pipe);
+	if (video->vsp2->hgt) {
+		struct vsp2_hgt *hgt = video->vsp2->hgt;
+		struct media_device *mdev = &video->vsp2->media_dev;
+
+		entity = &hgt->entity;
+
+		mutex_lock(&mdev->graph_mutex);
+		if (!hgt->pipe || hgt->pipe == pipe) {
+			ret = vsp2_hgt_validate(hgt, pipe);
+			if (ret < 0) {
+				mutex_unlock(&mdev->graph_mutex);
+				goto error;
+			}
+
+			if (entity->ops->configure)
+				entity->ops->configure(entity, pipe);
+
+			if (hgt->set_hgt == 1 && !hgt->pipe) {
+				hgt->pipe = pipe;
+				pipe->hgt = entity;
+			}
+		}
+		mutex_unlock(&mdev->graph_mutex);
 	}
 
 	/* We know that the WPF s_stream operation never fails. */
@@ -950,8 +1112,7 @@ static int vsp2_video_start_streaming(struct vb2_queue *vq, unsigned int count)
 		return 0;
 
 	spin_lock_irqsave(&pipe->irqlock, flags);
-	if (vsp2_pipeline_ready(pipe))
-		vsp2_video_pipeline_run(pipe);
+	vsp2_video_pipeline_schedule(pipe);
 	spin_unlock_irqrestore(&pipe->irqlock, flags);
 
 	return 0;
@@ -989,7 +1150,7 @@ static void vsp2_video_stop_streaming(struct vb2_queue *vq)
 	spin_unlock_irqrestore(&video->irqlock, flags);
 
 	mutex_lock(&pipe->lock);
-	if (--pipe->stream_count == pipe->num_inputs) {
+	if (--pipe->stream_count == pipe->num_video - 1) {
 		/* Stop the pipeline. */
 		ret = vsp2_pipeline_stop(pipe);
 		if (ret == -ETIMEDOUT)
@@ -1114,6 +1275,10 @@ vsp2_video_streamon(struct file *file, void *fh, enum v4l2_buf_type type)
 	if (video->queue.owner && video->queue.owner != file->private_data)
 		return -EBUSY;
 
+	/* The video node of a virtual RPF isn't part of the pipeline. */
+	if (video->rwpf->vir)
+		return -EINVAL;
+
 	/* Get a pipeline for the video node and start streaming on it. No link
 	 * touching an entity in the pipeline can be activated or deactivated
 	 * once streaming is started.
@@ -1126,6 +1291,13 @@ vsp2_video_streamon(struct file *file, void *fh, enum v4l2_buf_type type)
 		return PTR_ERR(pipe);
 	}
 
+	/* The BRU may be in use by a VIDIOC_VSP2_BRU_COMPOSE composition. */
+	if (pipe->bru && video->vsp2->compose->busy) {
+		mutex_unlock(&mdev->graph_mutex);
+		ret = -EBUSY;
+		goto err_pipe;
+	}
+
 	ret = __media_pipeline_start(&video->video.entity, &pipe->pipe);
 	if (ret < 0) {
 		mutex_unlock(&mdev->graph_mutex);
@@ -1394,6 +1566,9 @@ struct vsp2_video *vsp2_video_create(struct vsp2_device *vsp2,
 	video->queue.drv_priv = video;
 	video->queue.buf_struct_size = sizeof(struct vsp2_vb2_buffer);
 	video->queue.ops = &vsp2_video_queue_qops;
+	/* The RPF and WPF take a single address per plane, buffers are
+	 * contiguous in the device address space, through the IOMMU if any.
+	 */
 	video->queue.mem_ops = &vb2_dma_contig_memops;
 	video->queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
 	video->queue.dev = video->vsp2->dev;
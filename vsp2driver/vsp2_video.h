@@ -70,6 +70,8 @@ struct vsp2_vb2_buffer {
 	struct list_head queue;
 
 	struct vsp2_rwpf_memory mem;
+	bool active;	/* handed to the hardware */
+	struct v4l2_rect damage;	/* output area to update, WPF only */
 };
 
 static inline struct vsp2_vb2_buffer *
@@ -60,6 +60,7 @@
 #include "vsp2_vspm.h"
 #include "vsp2_debug.h"
 #include "vsp2_pipe.h"
+#include "vsp2_regs.h"
 #include "vsp2_rwpf.h"
 
 void vsp2_vspm_param_init(struct vspm_job_t *par)
@@ -268,13 +269,42 @@ static int vsp2_vspm_alloc_vsp_brs(struct device *dev, struct vsp_brs_t **brs)
 	return 0;
 }
 
+static int vsp2_vspm_alloc_ch(struct vsp2_device *vsp2,
+			      struct vsp2_vspm_ch *ch)
+{
+	struct vsp_start_t *vsp_par = NULL;
+	void		*virt_addr;		/* for dl_par */
+	dma_addr_t	hard_addr;		/* for dl_par */
+
+	ch->vsp2 = vsp2;
+
+	ch->par = devm_kzalloc(vsp2->dev, sizeof(*ch->par), GFP_KERNEL);
+	if (!ch->par)
+		return -ENOMEM;
+
+	vsp_par = &ch->par->start;
+
+	ch->ip_par.type = VSPM_TYPE_VSP_AUTO;
+	ch->ip_par.par.vsp = vsp_par;
+
+	/* Each channel needs its own display list as jobs run concurrently. */
+	virt_addr = dma_alloc_coherent(vsp2->dev, VSP2_VSPM_DL_NUM * 8,
+				       &hard_addr, GFP_KERNEL);
+	if (!virt_addr)
+		return -ENOMEM;
+
+	vsp_par->dl_par.hard_addr = (unsigned int)(hard_addr);
+	vsp_par->dl_par.virt_addr = virt_addr;
+	vsp_par->dl_par.tbl_num = VSP2_VSPM_DL_NUM;
+
+	return 0;
+}
+
 static int vsp2_vspm_alloc(struct vsp2_device *vsp2)
 {
 	struct vsp_start_t *vsp_par = NULL;
 	int ret = 0;
 	int i;
-	void		*virt_addr;		/* for dl_par */
-	dma_addr_t	hard_addr;		/* for dl_par */
 
 	vsp2->vspm = devm_kzalloc(vsp2->dev, sizeof(*vsp2->vspm), GFP_KERNEL);
 	if (!vsp2->vspm)
@@ -323,6 +353,26 @@ static int vsp2_vspm_alloc(struct vsp2_device *vsp2)
 	if (!vsp_par->ctrl_par->uds)
 		return -ENOMEM;
 
+	vsp_par->ctrl_par->sru =
+	  devm_kzalloc(vsp2->dev, sizeof(*vsp_par->ctrl_par->sru), GFP_KERNEL);
+	if (!vsp_par->ctrl_par->sru)
+		return -ENOMEM;
+
+	vsp_par->ctrl_par->shp =
+	  devm_kzalloc(vsp2->dev, sizeof(*vsp_par->ctrl_par->shp), GFP_KERNEL);
+	if (!vsp_par->ctrl_par->shp)
+		return -ENOMEM;
+
+	vsp_par->ctrl_par->hst =
+	  devm_kzalloc(vsp2->dev, sizeof(*vsp_par->ctrl_par->hst), GFP_KERNEL);
+	if (!vsp_par->ctrl_par->hst)
+		return -ENOMEM;
+
+	vsp_par->ctrl_par->hsi =
+	  devm_kzalloc(vsp2->dev, sizeof(*vsp_par->ctrl_par->hsi), GFP_KERNEL);
+	if (!vsp_par->ctrl_par->hsi)
+		return -ENOMEM;
+
 	vsp_par->ctrl_par->lut =
 	  devm_kzalloc(vsp2->dev, sizeof(*vsp_par->ctrl_par->lut), GFP_KERNEL);
 	if (!vsp_par->ctrl_par->lut)
@@ -343,14 +393,11 @@ static int vsp2_vspm_alloc(struct vsp2_device *vsp2)
 	if (!vsp_par->ctrl_par->hgt)
 		return -ENOMEM;
 
-	virt_addr = dma_alloc_coherent(vsp2->dev, (128 + 2048) * 8,
-				       &hard_addr, GFP_KERNEL | GFP_DMA);
-	if (!virt_addr)
-		return -ENOMEM;
-
-	vsp_par->dl_par.hard_addr = (unsigned int)(hard_addr);
-	vsp_par->dl_par.virt_addr = virt_addr;
-	vsp_par->dl_par.tbl_num = 128 + 2048;
+	for (i = 0; i < vsp2->pdata.ch_count; i++) {
+		ret = vsp2_vspm_alloc_ch(vsp2, &vsp2->vspm->ch[i]);
+		if (ret != 0)
+			return -ENOMEM;
+	}
 
 	return 0;
 }
@@ -365,11 +412,11 @@ static bool vsp2_vspm_is_yvup(const struct vsp2_format_info *format)
 	return false;
 }
 
-static void vsp2_vspm_yvup_swap(struct vsp2_device *vsp2)
+static void vsp2_vspm_yvup_swap(struct vsp2_device *vsp2,
+				struct vsp_start_t *vsp_par)
 {
 	int i;
 	unsigned int tmp;
-	struct vsp_start_t *vsp_par = vsp2->vspm->ip_par.par.vsp;
 
 	/* If format is YVU planar, change Cb Cr address. */
 
@@ -391,165 +438,861 @@ static void vsp2_vspm_yvup_swap(struct vsp2_device *vsp2)
 	}
 }
 
+static const unsigned long vsp2_vspm_lay[] = {
+	VSP_LAY_1, VSP_LAY_2, VSP_LAY_3, VSP_LAY_4,
+#ifdef TYPE_GEN2 /* TODO: delete TYPE_GEN2 */
+#else
+	VSP_LAY_5,
+#endif
+};
+
+/* Sort the RPFs from bottom to top, ties are broken by RPF index. */
+static void vsp2_vspm_sort_layers(const unsigned char *zpos,
+				  unsigned int num, unsigned int *order)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < num; i++)
+		order[i] = i;
+
+	if (!zpos)
+		return;
+
+	for (i = 1; i < num; i++) {
+		for (j = i; j > 0 && zpos[order[j - 1]] > zpos[order[j]]; j--)
+			swap(order[j - 1], order[j]);
+	}
+}
+
+/*
+ * vsp2_vspm_set_lay_order - Stack the RPFs in the BRU or BRS
+ * @job: the job parameters
+ * @zpos: stacking position of each RPF, NULL to stack them by index
+ *
+ * The Blend/ROP units are configured per RPF by the BRU and BRS entities, they
+ * are reordered to follow their RPF in the stack.
+ */
+static void vsp2_vspm_set_lay_order(struct vsp2_vspm_job_par *job,
+				    const unsigned char *zpos)
+{
+	struct vsp_start_t *vsp_par = &job->start;
+	struct vsp_bld_ctrl_t blend[5];
+	unsigned int order[5];
+	unsigned int num;
+	unsigned int i;
+
+	num = min_t(unsigned int, vsp_par->rpf_num,
+		    ARRAY_SIZE(vsp2_vspm_lay));
+
+	if (vsp_par->use_module & VSP_BRU_USE) {
+		/* Set lay_order of BRU. */
+		vsp2_vspm_sort_layers(zpos, num, order);
+
+		vsp_par->ctrl_par->bru->lay_order = VSP_LAY_VIRTUAL;
+		for (i = 0; i < num; i++)
+			vsp_par->ctrl_par->bru->lay_order |=
+				vsp2_vspm_lay[order[i]] << ((i + 1) * 4);
+
+		memcpy(blend, job->bru_blend, sizeof(job->bru_blend));
+		for (i = 0; i < num; i++)
+			job->bru_blend[i] = blend[order[i]];
+
+	} else if (vsp_par->use_module & VSP_BRS_USE) {
+		/* Set lay_order of BRS. */
+		num = min_t(unsigned int, num, ARRAY_SIZE(job->brs_blend));
+		vsp2_vspm_sort_layers(zpos, num, order);
+
+		vsp_par->ctrl_par->brs->lay_order = VSP_LAY_VIRTUAL;
+		for (i = 0; i < num; i++)
+			vsp_par->ctrl_par->brs->lay_order |=
+				vsp2_vspm_lay[order[i]] << ((i + 1) * 4);
+
+		memcpy(blend, job->brs_blend, sizeof(job->brs_blend));
+		for (i = 0; i < num; i++)
+			job->brs_blend[i] = blend[order[i]];
+
+	} else {
+		/* Not use BRU and BRS. Set RPF0 to parent layer. */
+		vsp_par->src_par[0]->pwd = VSP_LAYER_PARENT;
+	}
+}
+
+/*
+ * VSPM has no UDS initial phase parameter, each half is scaled from phase 0
+ * at the first pixel of its input window. Among the window starts that
+ * keep at least the overlap on the inner side, pick the one whose position
+ * in the output is the closest to a pixel boundary, so that the right half
+ * samples the input as close as possible to the full frame.
+ */
+static unsigned int vsp2_vspm_split_start(unsigned int start,
+					  unsigned int ratio,
+					  unsigned int overlap,
+					  unsigned int hsub)
+{
+	unsigned int best = start;
+	unsigned int best_err = ratio;
+	unsigned int x;
+
+	for (x = start; x + overlap >= start; x -= hsub) {
+		unsigned int rem = ((u64)x * 4096) % ratio;
+		unsigned int err = min(rem, ratio - rem);
+
+		if (err < best_err) {
+			best = x;
+			best_err = err;
+		}
+
+		if (x < hsub)
+			break;
+	}
+
+	return best;
+}
+
+/*
+ * vsp2_vspm_split_par - Restrict the job parameters to half of the frame
+ * @vsp2: the VSP2 device
+ * @vsp_par: the job parameters, describing the full frame
+ * @right: select the right half, the left half otherwise
+ *
+ * The output is split at its middle. The input window of each half is extended
+ * by VSP2_VSPM_SPLIT_OVERLAP pixels on the inner side when the UDS is used, so
+ * that the filter taps see the same pixels as for the full frame. The output
+ * pixels computed from the overlap are then discarded with the WPF clipping.
+ *
+ * The histogram generators are disabled, the halves would overwrite each
+ * other's histogram.
+ */
+static void vsp2_vspm_split_par(struct vsp2_device *vsp2,
+				struct vsp_start_t *vsp_par, bool right)
+{
+	const struct vsp2_format_info *in_fmt = vsp2->rpf[0]->fmtinfo;
+	const struct vsp2_format_info *out_fmt = vsp2->wpf[0]->fmtinfo;
+	struct vsp_src_t *vsp_in = vsp_par->src_par[0];
+	struct vsp_dst_t *vsp_out = vsp_par->dst_par;
+	unsigned int ratio = 4096;
+	unsigned int overlap = 0;
+	unsigned int out_start, out_end;
+	unsigned int in_start, in_end;
+	unsigned int split;
+
+	vsp_par->use_module &= ~(VSP_HGO_USE | VSP_HGT_USE);
+
+	if (vsp_par->use_module & VSP_UDS_USE) {
+		ratio = vsp_par->ctrl_par->uds->x_ratio;
+		overlap = VSP2_VSPM_SPLIT_OVERLAP;
+	}
+
+	/* Keep the split point aligned on chroma subsampling boundaries. */
+	split = round_down(vsp_out->width / 2, 2);
+
+	out_start = right ? split : 0;
+	out_end = right ? vsp_out->width : split;
+
+	in_start = out_start * ratio / 4096;
+	in_start = in_start > overlap ? in_start - overlap : 0;
+	in_start = round_down(in_start, in_fmt->hsub);
+	if (in_start && overlap)
+		in_start = vsp2_vspm_split_start(in_start, ratio, overlap,
+						 in_fmt->hsub);
+
+	in_end = DIV_ROUND_UP(out_end * ratio, 4096) + overlap;
+	in_end = min_t(unsigned int, in_end, vsp_in->width);
+
+	/* Input window. */
+	vsp_in->width = in_end - in_start;
+	vsp_in->addr += in_start * in_fmt->bpp[0] / 8;
+	if (vsp_in->addr_c0)
+		vsp_in->addr_c0 += in_start * in_fmt->bpp[1] / in_fmt->hsub / 8;
+	if (vsp_in->addr_c1)
+		vsp_in->addr_c1 += in_start * in_fmt->bpp[2] / in_fmt->hsub / 8;
+
+	/* Output window, clipping the pixels computed from the overlap. */
+	vsp_out->x_offset = out_start -
+			    DIV_ROUND_CLOSEST(in_start * 4096, ratio);
+	vsp_out->width = out_end - out_start;
+	vsp_out->addr += out_start * (out_fmt->bpp[0] / 8);
+	if (vsp_out->addr_c0)
+		vsp_out->addr_c0 += out_start * (out_fmt->bpp[1] / 8)
+				  / out_fmt->hsub;
+	if (vsp_out->addr_c1)
+		vsp_out->addr_c1 += out_start * (out_fmt->bpp[2] / 8)
+				  / out_fmt->hsub;
+}
+
+static bool vsp2_vspm_damage_aligned(struct vsp2_device *vsp2,
+				     struct vsp_start_t *vsp_par,
+				     unsigned int left, unsigned int top)
+{
+	unsigned int i;
+
+	for (i = 0; i < vsp_par->rpf_num; i++) {
+		const struct vsp2_format_info *fmt = vsp2->rpf[i]->fmtinfo;
+		struct vsp_src_t *vsp_in = vsp_par->src_par[i];
+
+		if (vsp_in->vir == VSP_VIR)
+			continue;
+
+		if (left > vsp_in->x_position &&
+		    (left - vsp_in->x_position) % fmt->hsub)
+			return false;
+		if (top > vsp_in->y_position &&
+		    (top - vsp_in->y_position) % fmt->vsub)
+			return false;
+	}
+
+	return true;
+}
+
+/* A transparent SRC leaves the DST untouched with plain alpha blending only. */
+static bool vsp2_vspm_blend_neutral(const struct vsp_bld_ctrl_t *ctrl)
+{
+	if (!ctrl)
+		return true;
+
+	if (!ctrl->rbc)
+		return ctrl->crop == VI6_ROP_NOP && ctrl->arop == VI6_ROP_NOP;
+
+	return ctrl->blend_formula == VSP_FORM_BLEND0 &&
+	       ctrl->blend_coefx == VSP_COEFFICIENT_BLENDX4 &&
+	       (ctrl->blend_coefy == VSP_COEFFICIENT_BLENDY3 ||
+		ctrl->blend_coefy == VSP_COEFFICIENT_BLENDY5) &&
+	       ctrl->aformula == VSP_FORM_ALPHA0 &&
+	       ctrl->acoefx == VSP_COEFFICIENT_ALPHAX4 &&
+	       ctrl->acoefy == VSP_COEFFICIENT_ALPHAY5;
+}
+
+/*
+ * Inputs outside of the damaged area are replaced by a transparent pixel,
+ * which only leaves the output untouched when it is alpha blended and not
+ * color keyed.
+ */
+static bool vsp2_vspm_damage_neutral(struct vsp_start_t *vsp_par,
+				     unsigned int left, unsigned int top,
+				     unsigned int right, unsigned int bottom)
+{
+	unsigned int i;
+
+	if (vsp_par->use_module & VSP_BRU_USE) {
+		struct vsp_bru_t *bru = vsp_par->ctrl_par->bru;
+
+		if (!vsp2_vspm_blend_neutral(bru->blend_unit_a) ||
+		    !vsp2_vspm_blend_neutral(bru->blend_unit_b) ||
+		    !vsp2_vspm_blend_neutral(bru->blend_unit_c) ||
+		    !vsp2_vspm_blend_neutral(bru->blend_unit_d) ||
+		    !vsp2_vspm_blend_neutral(bru->blend_unit_e))
+			return false;
+	} else {
+		struct vsp_brs_t *brs = vsp_par->ctrl_par->brs;
+
+		if (!vsp2_vspm_blend_neutral(brs->blend_unit_a) ||
+		    !vsp2_vspm_blend_neutral(brs->blend_unit_b))
+			return false;
+	}
+
+	for (i = 0; i < vsp_par->rpf_num; i++) {
+		struct vsp_src_t *vsp_in = vsp_par->src_par[i];
+
+		if (!vsp_in->alpha->ckey)
+			continue;
+
+		if (left >= vsp_in->x_position + vsp_in->width ||
+		    top >= vsp_in->y_position + vsp_in->height ||
+		    right <= vsp_in->x_position ||
+		    bottom <= vsp_in->y_position)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * vsp2_vspm_damage_par - Restrict the job parameters to the damaged area
+ * @vsp2: the VSP2 device
+ * @vsp_par: the job parameters, describing the full frame
+ * @damage: the damaged area of the output
+ *
+ * The BRU or BRS virtual area is shrunk to the damaged area, aligned on
+ * chroma subsampling boundaries, and the inputs are cropped and moved
+ * accordingly. Inputs outside of the area are reduced to a single transparent
+ * pixel as the number of inputs is fixed by the layer order. The WPF only
+ * writes the damaged area of the output buffer.
+ *
+ * The full frame is processed if an input would need to be cropped inside a
+ * chroma sample, or if a transparent input wouldn't be neutral because a
+ * Blend/ROP unit isn't in alpha blending mode or the input is color keyed.
+ */
+static void vsp2_vspm_damage_par(struct vsp2_device *vsp2,
+				 struct vsp_start_t *vsp_par,
+				 const struct v4l2_rect *damage)
+{
+	const struct vsp2_format_info *out_fmt = vsp2->wpf[0]->fmtinfo;
+	struct vsp_dst_t *vsp_out = vsp_par->dst_par;
+	struct vsp_bld_vir_t *vir;
+	unsigned int left, top, right, bottom;
+	unsigned int i;
+
+	if (vsp_par->use_module & VSP_BRU_USE)
+		vir = vsp_par->ctrl_par->bru->blend_virtual;
+	else
+		vir = vsp_par->ctrl_par->brs->blend_virtual;
+
+	left = round_down(damage->left, 2);
+	top = round_down(damage->top, 2);
+	right = min_t(unsigned int, round_up(damage->left + damage->width, 2),
+		      vir->width);
+	bottom = min_t(unsigned int, round_up(damage->top + damage->height, 2),
+		       vir->height);
+
+	if (left >= right || top >= bottom)
+		return;
+
+	if (!vsp2_vspm_damage_aligned(vsp2, vsp_par, left, top))
+		return;
+
+	if (!vsp2_vspm_damage_neutral(vsp_par, left, top, right, bottom))
+		return;
+
+	for (i = 0; i < vsp_par->rpf_num; i++) {
+		const struct vsp2_format_info *fmt = vsp2->rpf[i]->fmtinfo;
+		struct vsp_src_t *vsp_in = vsp_par->src_par[i];
+		unsigned int x0, y0, x1, y1;
+		unsigned int dx, dy;
+
+		x0 = max_t(unsigned int, left, vsp_in->x_position);
+		y0 = max_t(unsigned int, top, vsp_in->y_position);
+		x1 = min_t(unsigned int, right,
+			   vsp_in->x_position + vsp_in->width);
+		y1 = min_t(unsigned int, bottom,
+			   vsp_in->y_position + vsp_in->height);
+
+		if (x0 >= x1 || y0 >= y1) {
+			vsp_in->width = fmt->hsub;
+			vsp_in->height = fmt->vsub;
+			vsp_in->x_position = 0;
+			vsp_in->y_position = 0;
+			vsp_in->alpha->mult->a_mmd = VSP_MULT_RATIO;
+			vsp_in->alpha->mult->p_mmd = VSP_MULT_RATIO;
+			vsp_in->alpha->mult->ratio = 0;
+			continue;
+		}
+
+		dx = x0 - vsp_in->x_position;
+		dy = y0 - vsp_in->y_position;
+
+		/* A virtual input has no memory to crop. */
+		if (vsp_in->vir == VSP_VIR) {
+			dx = 0;
+			dy = 0;
+		}
+
+		vsp_in->addr += dy * vsp_in->stride + dx * fmt->bpp[0] / 8;
+		if (vsp_in->addr_c0)
+			vsp_in->addr_c0 += dy / fmt->vsub * vsp_in->stride_c
+					 + dx * fmt->bpp[1] / fmt->hsub / 8;
+		if (vsp_in->addr_c1)
+			vsp_in->addr_c1 += dy / fmt->vsub * vsp_in->stride_c
+					 + dx * fmt->bpp[2] / fmt->hsub / 8;
+
+		vsp_in->width = x1 - x0;
+		vsp_in->height = y1 - y0;
+		vsp_in->x_position = x0 - left;
+		vsp_in->y_position = y0 - top;
+	}
+
+	vir->width = right - left;
+	vir->height = bottom - top;
+
+	vsp_out->addr += top * vsp_out->stride + left * (out_fmt->bpp[0] / 8);
+	if (vsp_out->addr_c0)
+		vsp_out->addr_c0 += top / out_fmt->vsub * vsp_out->stride_c
+				  + left * (out_fmt->bpp[1] / 8)
+				  / out_fmt->hsub;
+	if (vsp_out->addr_c1)
+		vsp_out->addr_c1 += top / out_fmt->vsub * vsp_out->stride_c
+				  + left * (out_fmt->bpp[2] / 8)
+				  / out_fmt->hsub;
+	vsp_out->width = right - left;
+	vsp_out->height = bottom - top;
+}
+
+/*
+ * Copy the VSPM parameters of a job to the channel storage. Sub-structures
+ * are copied by value, NULL pointers are preserved.
+ */
+#define VSP2_VSPM_COPY(dst, src, storage)	\
+	do {					\
+		if (src) {			\
+			(storage) = *(src);	\
+			(dst) = &(storage);	\
+		} else {			\
+			(dst) = NULL;		\
+		}				\
+	} while (0)
+
+static void vsp2_vspm_copy_par(struct vsp2_vspm_job_par *job,
+			       const struct vsp_start_t *src)
+{
+	struct vsp_start_t *dst = &job->start;
+	const struct vsp_ctrl_t *ctrl = src->ctrl_par;
+	unsigned int i;
+
+	dst->rpf_num	= src->rpf_num;
+	dst->rpf_order	= src->rpf_order;
+	dst->use_module	= src->use_module;
+
+	for (i = 0; i < 5; i++) {
+		const struct vsp_src_t *in = src->src_par[i];
+		struct vsp_alpha_unit_t *alpha = &job->alpha[i];
+
+		VSP2_VSPM_COPY(dst->src_par[i], in, job->src[i]);
+		if (!in)
+			continue;
+
+		VSP2_VSPM_COPY(job->src[i].clut, in->clut, job->clut[i]);
+		VSP2_VSPM_COPY(job->src[i].alpha, in->alpha, *alpha);
+		if (!in->alpha)
+			continue;
+
+		VSP2_VSPM_COPY(alpha->irop, in->alpha->irop, job->irop[i]);
+		VSP2_VSPM_COPY(alpha->ckey, in->alpha->ckey, job->ckey[i]);
+		VSP2_VSPM_COPY(alpha->mult, in->alpha->mult, job->mult[i]);
+	}
+
+	VSP2_VSPM_COPY(dst->dst_par, src->dst_par, job->dst);
+	if (src->dst_par)
+		VSP2_VSPM_COPY(job->dst.fcp, src->dst_par->fcp, job->fcp);
+
+	VSP2_VSPM_COPY(dst->ctrl_par, ctrl, job->ctrl);
+	if (!ctrl)
+		return;
+
+	VSP2_VSPM_COPY(job->ctrl.sru, ctrl->sru, job->sru);
+	VSP2_VSPM_COPY(job->ctrl.uds, ctrl->uds, job->uds);
+	VSP2_VSPM_COPY(job->ctrl.lut, ctrl->lut, job->lut);
+	VSP2_VSPM_COPY(job->ctrl.clu, ctrl->clu, job->clu);
+	VSP2_VSPM_COPY(job->ctrl.hst, ctrl->hst, job->hst);
+	VSP2_VSPM_COPY(job->ctrl.hsi, ctrl->hsi, job->hsi);
+	VSP2_VSPM_COPY(job->ctrl.hgo, ctrl->hgo, job->hgo);
+	VSP2_VSPM_COPY(job->ctrl.hgt, ctrl->hgt, job->hgt);
+	VSP2_VSPM_COPY(job->ctrl.shp, ctrl->shp, job->shp);
+
+	VSP2_VSPM_COPY(job->ctrl.bru, ctrl->bru, job->bru);
+	if (ctrl->bru) {
+		const struct vsp_bru_t *bru = ctrl->bru;
+
+		VSP2_VSPM_COPY(job->bru.blend_virtual, bru->blend_virtual,
+			       job->bru_virtual);
+		VSP2_VSPM_COPY(job->bru.blend_unit_a, bru->blend_unit_a,
+			       job->bru_blend[0]);
+		VSP2_VSPM_COPY(job->bru.blend_unit_b, bru->blend_unit_b,
+			       job->bru_blend[1]);
+		VSP2_VSPM_COPY(job->bru.blend_unit_c, bru->blend_unit_c,
+			       job->bru_blend[2]);
+		VSP2_VSPM_COPY(job->bru.blend_unit_d, bru->blend_unit_d,
+			       job->bru_blend[3]);
+		VSP2_VSPM_COPY(job->bru.blend_unit_e, bru->blend_unit_e,
+			       job->bru_blend[4]);
+		VSP2_VSPM_COPY(job->bru.rop_unit, bru->rop_unit, job->bru_rop);
+	}
+
+	VSP2_VSPM_COPY(job->ctrl.brs, ctrl->brs, job->brs);
+	if (ctrl->brs) {
+		const struct vsp_brs_t *brs = ctrl->brs;
+
+		VSP2_VSPM_COPY(job->brs.blend_virtual, brs->blend_virtual,
+			       job->brs_virtual);
+		VSP2_VSPM_COPY(job->brs.blend_unit_a, brs->blend_unit_a,
+			       job->brs_blend[0]);
+		VSP2_VSPM_COPY(job->brs.blend_unit_b, brs->blend_unit_b,
+			       job->brs_blend[1]);
+	}
+}
+
 long vsp2_vspm_drv_init(struct vsp2_device *vsp2)
 {
+	struct vsp2_vspm *vspm = vsp2->vspm;
 	long ret = R_VSPM_OK;
 	struct vspm_init_t init_par;
+	unsigned int i;
 
+	for (i = 0; i < vspm->ch_count; i++) {
 #ifdef TYPE_GEN2 /* TODO: delete TYPE_GEN2 */
-	init_par.use_ch = VSPM_USE_CH1;
+		init_par.use_ch = VSPM_USE_CH1;
 #else /*TYPE_GEN3 */
-	init_par.use_ch = vsp2->pdata.use_ch;
+		init_par.use_ch = vsp2->pdata.use_ch[i];
 #endif
-	if (init_par.use_ch == (unsigned int)VSPM_EMPTY_CH)
-		init_par.mode = VSPM_MODE_MUTUAL;
-	else
-		init_par.mode = VSPM_MODE_OCCUPY;
-	init_par.type = VSPM_TYPE_VSP_AUTO;
-	ret = vspm_init_driver(&vsp2->vspm->hdl, &init_par);
-	if (ret != R_VSPM_OK) {
-		dev_dbg(vsp2->dev,
-			"failed to vspm_init_driver : %ld\n",
-			ret);
-		return ret;
+		if (init_par.use_ch == (unsigned int)VSPM_EMPTY_CH)
+			init_par.mode = VSPM_MODE_MUTUAL;
+		else
+			init_par.mode = VSPM_MODE_OCCUPY;
+		init_par.type = VSPM_TYPE_VSP_AUTO;
+		ret = vspm_init_driver(&vspm->ch[i].hdl, &init_par);
+		if (ret != R_VSPM_OK) {
+			dev_dbg(vsp2->dev,
+				"failed to vspm_init_driver : %ld\n",
+				ret);
+
+			while (i--)
+				vspm_quit_driver(vspm->ch[i].hdl);
+
+			return ret;
+		}
+
+		vspm->ch[i].busy = false;
+		vspm->ch[i].done = false;
 	}
 
-	vsp2_vspm_param_init(&vsp2->vspm->ip_par);
+	vsp2_vspm_param_init(&vspm->ip_par);
 
 	return ret;
 }
 
 long vsp2_vspm_drv_quit(struct vsp2_device *vsp2)
 {
+	struct vsp2_vspm *vspm = vsp2->vspm;
 	long ret = R_VSPM_OK;
-
-	ret = vspm_quit_driver(vsp2->vspm->hdl);
-	if (ret != R_VSPM_OK) {
-		dev_dbg(vsp2->dev,
-			"failed to vspm_quit_driver : %ld\n",
-			ret);
+	long ch_ret;
+	unsigned int i;
+
+	for (i = 0; i < vspm->ch_count; i++) {
+		ch_ret = vspm_quit_driver(vspm->ch[i].hdl);
+		if (ch_ret != R_VSPM_OK) {
+			dev_dbg(vsp2->dev,
+				"failed to vspm_quit_driver : %ld\n",
+				ch_ret);
+			ret = ch_ret;
+		}
 	}
 
 	return ret;
 }
 
+static void vsp2_vspm_job_done(struct vsp2_vspm_ch *ch, long result)
+{
+	struct vsp2_vspm *vspm = ch->vsp2->vspm;
+	struct completion *sync;
+	unsigned long flags;
+
+	spin_lock_irqsave(&vspm->lock, flags);
+	ch->done = true;
+	ch->result = result;
+	sync = ch->sync;
+	spin_unlock_irqrestore(&vspm->lock, flags);
+
+	if (sync) {
+		complete(sync);
+		return;
+	}
+
+	vsp2_frame_end(ch->vsp2);
+}
+
 static void vsp2_vspm_drv_entry_cb(unsigned long job_id, long result,
 				   void *user_data)
 {
+	struct vsp2_vspm_ch *ch;
 	struct vsp2_device *vsp2;
+	unsigned int index;
 
 #ifdef VSP2_DEBUG
 	if (vsp2_debug_vspm_debug() == true)
 		print_vspm_entry_cb();
 #endif
 
-	vsp2 = (struct vsp2_device *)user_data;
+	ch = (struct vsp2_vspm_ch *)user_data;
+	vsp2 = ch->vsp2;
+	index = ch - vsp2->vspm->ch;
 
-	/* check job_id when mode is VSPM_MODE_MUTUAL */
-	if (vsp2->pdata.use_ch == (unsigned int)VSPM_EMPTY_CH)
-		if (job_id != vsp2->vspm->job_id)
+	/* check job_id when the channel mode is VSPM_MODE_MUTUAL */
+	if (vsp2->pdata.use_ch[index] == (unsigned int)VSPM_EMPTY_CH)
+		if (job_id != ch->job_id)
 			dev_err(vsp2->dev,
 				"vspm_entry_job: unexpected job id %lu (exp=%lu)\n",
-				job_id, vsp2->vspm->job_id);
+				job_id, ch->job_id);
 
 	if (result != R_VSPM_OK)
 		dev_err(vsp2->dev, "vspm_entry_job: result=%ld\n", result);
 
-	vsp2_frame_end(vsp2);
+	vsp2_vspm_job_done(ch, result);
 }
 
 static void vsp2_vspm_drv_entry_work(struct work_struct *work)
 {
 	long ret = R_VSPM_OK;
 
-	struct vsp2_vspm_entry_work *entry_work;
+	struct vsp2_vspm_ch *ch;
 	struct vsp2_device *vsp2;
-	struct vsp_start_t *vsp_par;
 
-	entry_work = (struct vsp2_vspm_entry_work *)work;
-	vsp2 = entry_work->vsp2;
-	vsp_par = vsp2->vspm->ip_par.par.vsp;
+	ch = container_of(work, struct vsp2_vspm_ch, work);
+	vsp2 = ch->vsp2;
 
-	if (vsp_par->use_module & VSP_BRU_USE) {
-		/* Set lay_order of BRU. */
-		vsp_par->ctrl_par->bru->lay_order = VSP_LAY_VIRTUAL;
+#ifdef VSP2_DEBUG
+	if (vsp2_debug_vspm_debug() == true)
+		print_vspm_entry(ch->ip_par.par.vsp);
+#endif
 
-		if (vsp_par->rpf_num >= 1)
-			vsp_par->ctrl_par->bru->lay_order |= (VSP_LAY_1 << 4);
+	ret = vspm_entry_job(ch->hdl, &ch->job_id,
+			     vsp2->vspm->job_pri, &ch->ip_par,
+			     ch, vsp2_vspm_drv_entry_cb);
+	if (ret != R_VSPM_OK) {
+		dev_err(vsp2->dev, "failed to vspm_entry_job : %ld\n", ret);
 
-		if (vsp_par->rpf_num >= 2)
-			vsp_par->ctrl_par->bru->lay_order |= (VSP_LAY_2 << 8);
+		vsp2_vspm_job_done(ch, ret);
+	}
+}
 
-		if (vsp_par->rpf_num >= 3)
-			vsp_par->ctrl_par->bru->lay_order |= (VSP_LAY_3 << 12);
+/*
+ * vsp2_vspm_drv_entry - Hand the current parameters to free channels
+ * @vsp2: the VSP2 device
+ * @seq: pipeline sequence number of the job
+ * @split: split the frame in two halves processed on two channels
+ * @damage: output area to update, NULL for the full frame
+ *
+ * The parameters are copied to the channel storage, the caller is thus free
+ * to prepare the next job as soon as this function returns.
+ *
+ * Return 0 on success or -EBUSY if not enough channels are free.
+ */
+int vsp2_vspm_drv_entry(struct vsp2_device *vsp2, unsigned int seq,
+			bool split, const struct v4l2_rect *damage)
+{
+	struct vsp2_vspm *vspm = vsp2->vspm;
+	struct vsp2_vspm_ch *chs[2] = { NULL, NULL };
+	unsigned int num = split ? 2 : 1;
+	unsigned int n = 0;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&vspm->lock, flags);
+	for (i = 0; i < vspm->ch_count; i++) {
+		if (!vspm->ch[i].busy)
+			n++;
+	}
 
-		if (vsp_par->rpf_num >= 4)
-			vsp_par->ctrl_par->bru->lay_order |= (VSP_LAY_4 << 16);
+	if (n < num) {
+		spin_unlock_irqrestore(&vspm->lock, flags);
+		return -EBUSY;
+	}
 
-#ifdef TYPE_GEN2 /* TODO: delete TYPE_GEN2 */
-#else
-		if (vsp_par->rpf_num >= 5)
-			vsp_par->ctrl_par->bru->lay_order |= (VSP_LAY_5 << 20);
-#endif
+	for (i = 0, n = 0; i < vspm->ch_count && n < num; i++) {
+		struct vsp2_vspm_ch *ch = &vspm->ch[i];
 
-	} else if (vsp_par->use_module & VSP_BRS_USE) {
-		/* Set lay_order of BRS. */
-		vsp_par->ctrl_par->brs->lay_order = VSP_LAY_VIRTUAL;
+		if (ch->busy)
+			continue;
 
-		if (vsp_par->rpf_num >= 1)
-			vsp_par->ctrl_par->brs->lay_order |= (VSP_LAY_1 << 4);
+		ch->busy = true;
+		ch->done = false;
+		ch->seq = seq;
+		chs[n++] = ch;
+	}
+	spin_unlock_irqrestore(&vspm->lock, flags);
+
+	for (i = 0; i < num; i++) {
+		struct vsp_start_t *vsp_par = &chs[i]->par->start;
+
+		vsp2_vspm_copy_par(chs[i]->par, vspm->ip_par.par.vsp);
+		vsp2_vspm_set_lay_order(chs[i]->par, vspm->zpos);
+		if (split)
+			vsp2_vspm_split_par(vsp2, vsp_par, i == 1);
+		if (damage)
+			vsp2_vspm_damage_par(vsp2, vsp_par, damage);
+		vsp2_vspm_yvup_swap(vsp2, vsp_par);
+	}
 
-		if (vsp_par->rpf_num >= 2)
-			vsp_par->ctrl_par->brs->lay_order |= (VSP_LAY_2 << 8);
+	for (i = 0; i < num; i++)
+		schedule_work(&chs[i]->work);
 
-	} else {
-		/* Not use BRU and BRS. Set RPF0 to parent layer. */
-		vsp_par->src_par[0]->pwd = VSP_LAYER_PARENT;
+	return 0;
+}
+
+static struct vsp2_vspm_ch *vsp2_vspm_claim_ch(struct vsp2_vspm *vspm,
+						struct completion *sync)
+{
+	struct vsp2_vspm_ch *ch = NULL;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&vspm->lock, flags);
+	for (i = 0; i < vspm->ch_count; i++) {
+		if (!vspm->ch[i].busy) {
+			ch = &vspm->ch[i];
+			ch->busy = true;
+			ch->done = false;
+			ch->sync = sync;
+			break;
+		}
 	}
+	spin_unlock_irqrestore(&vspm->lock, flags);
 
-	vsp2_vspm_yvup_swap(vsp2);
+	return ch;
+}
 
-#ifdef VSP2_DEBUG
-	if (vsp2_debug_vspm_debug() == true)
-		print_vspm_entry(vsp2->vspm->ip_par.par.vsp);
-#endif
+/*
+ * vsp2_vspm_job_run - Run a job outside of the pipeline and wait for it
+ * @vsp2: the VSP2 device
+ * @vsp_par: the job parameters
+ *
+ * The job is handed to a free channel like pipeline jobs, but its completion
+ * is reported to the caller instead of the pipeline. When all channels are
+ * used by streaming pipelines the function sleeps until one is released. The
+ * caller must hold a reference to the device.
+ *
+ * Return 0 on success, -ERESTARTSYS if interrupted while waiting for a
+ * channel or -EIO if the VSPM driver failed to process the job.
+ */
+int vsp2_vspm_job_run(struct vsp2_device *vsp2,
+		      const struct vsp_start_t *vsp_par)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct vsp2_vspm *vspm = vsp2->vspm;
+	struct vsp2_vspm_ch *ch = NULL;
+	unsigned long flags;
+	long result;
+	int ret;
+
+	ret = wait_event_interruptible(vspm->ch_wait,
+				       (ch = vsp2_vspm_claim_ch(vspm, &done)));
+	if (ret < 0)
+		return ret;
 
-	ret = vspm_entry_job(vsp2->vspm->hdl, &vsp2->vspm->job_id,
-			     vsp2->vspm->job_pri, &vsp2->vspm->ip_par,
-			     vsp2, vsp2_vspm_drv_entry_cb);
-	if (ret != R_VSPM_OK) {
-		dev_err(vsp2->dev, "failed to vspm_entry_job : %ld\n", ret);
+	vsp2_vspm_copy_par(ch->par, vsp_par);
+	vsp2_vspm_set_lay_order(ch->par, NULL);
+	schedule_work(&ch->work);
+
+	/* The VSPM driver always reports the job completion, including on
+	 * timeout, the completion lives on the stack and must be waited for.
+	 */
+	wait_for_completion(&done);
+
+	spin_lock_irqsave(&vspm->lock, flags);
+	result = ch->result;
+	ch->sync = NULL;
+	ch->busy = false;
+	spin_unlock_irqrestore(&vspm->lock, flags);
+
+	wake_up(&vspm->ch_wait);
+
+	/* Streaming pipelines may have failed to get the channel, resume
+	 * them now that it is free.
+	 */
+	vsp2_frame_end(vsp2);
 
-		vsp2_frame_end(vsp2);
+	return result == R_VSPM_OK ? 0 : -EIO;
+}
+
+/*
+ * vsp2_vspm_free_channels - Count the channels able to accept a job
+ */
+unsigned int vsp2_vspm_free_channels(struct vsp2_device *vsp2)
+{
+	struct vsp2_vspm *vspm = vsp2->vspm;
+	unsigned int count = 0;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&vspm->lock, flags);
+	for (i = 0; i < vspm->ch_count; i++) {
+		if (!vspm->ch[i].busy)
+			count++;
 	}
+	spin_unlock_irqrestore(&vspm->lock, flags);
+
+	return count;
 }
 
-void vsp2_vspm_drv_entry(struct vsp2_device *vsp2)
+/*
+ * vsp2_vspm_job_retire - Release the channels of a completed job
+ * @vsp2: the VSP2 device
+ * @seq: pipeline sequence number of the job
+ *
+ * Jobs can complete out of order when several channels are used. Callers
+ * retire jobs in sequence order to complete the buffers in order.
+ *
+ * Return true if the job has completed on all its channels and has been
+ * retired, or false if it is still running or doesn't exist.
+ */
+bool vsp2_vspm_job_retire(struct vsp2_device *vsp2, unsigned int seq)
 {
-	vsp2->vspm->entry_work.vsp2 = vsp2;
+	struct vsp2_vspm *vspm = vsp2->vspm;
+	bool found = false;
+	bool done = true;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&vspm->lock, flags);
 
-	schedule_work((struct work_struct *)&vsp2->vspm->entry_work);
+	for (i = 0; i < vspm->ch_count; i++) {
+		struct vsp2_vspm_ch *ch = &vspm->ch[i];
+
+		if (ch->busy && !ch->sync && ch->seq == seq) {
+			found = true;
+			done &= ch->done;
+		}
+	}
+
+	if (found && done) {
+		for (i = 0; i < vspm->ch_count; i++) {
+			struct vsp2_vspm_ch *ch = &vspm->ch[i];
+
+			if (ch->busy && !ch->sync && ch->seq == seq)
+				ch->busy = false;
+		}
+	}
+
+	spin_unlock_irqrestore(&vspm->lock, flags);
+
+	if (found && done)
+		wake_up(&vspm->ch_wait);
+
+	return found && done;
 }
 
-static void vsp2_vspm_work_queue_init(struct vsp2_device *vsp2)
+static void vsp2_vspm_free(struct vsp2_device *vsp2)
 {
-	/* Initialize the work queue
-	 * for the entry of job to the VSPM driver.
-	 */
-	INIT_WORK((struct work_struct *)&vsp2->vspm->entry_work,
-		  vsp2_vspm_drv_entry_work);
+	struct vsp2_vspm *vspm = vsp2->vspm;
+	struct vsp_start_t *vsp_par;
+	unsigned int i;
+
+	/* dl_par */
+	for (i = 0; i < vsp2->pdata.ch_count; i++) {
+		if (!vspm->ch[i].par)
+			continue;
+
+		vsp_par = &vspm->ch[i].par->start;
+		if (!vsp_par->dl_par.virt_addr)
+			continue;
+
+		dma_free_coherent(
+			vsp2->dev,
+			VSP2_VSPM_DL_NUM * 8,
+			vsp_par->dl_par.virt_addr,
+			(dma_addr_t)(vsp_par->dl_par.hard_addr));
+	}
 }
 
 int vsp2_vspm_init(struct vsp2_device *vsp2, int dev_id)
 {
 	int ret = 0;
+	unsigned int i;
 
 	ret = vsp2_vspm_alloc(vsp2);
-	if (ret != 0)
+	if (ret != 0) {
+		if (vsp2->vspm)
+			vsp2_vspm_free(vsp2);
 		return -ENOMEM;
+	}
 
-	/* Initialize the work queue. */
-	vsp2_vspm_work_queue_init(vsp2);
+	spin_lock_init(&vsp2->vspm->lock);
+	init_waitqueue_head(&vsp2->vspm->ch_wait);
+
+	vsp2->vspm->ch_count = vsp2->pdata.ch_count;
+
+	/* Initialize the work queue
+	 * for the entry of job to the VSPM driver.
+	 */
+	for (i = 0; i < vsp2->vspm->ch_count; i++)
+		INIT_WORK(&vsp2->vspm->ch[i].work, vsp2_vspm_drv_entry_work);
 
 	/* Initialize the parameters to VSPM driver. */
 	vsp2_vspm_param_init(&vsp2->vspm->ip_par);
@@ -561,18 +1304,6 @@ int vsp2_vspm_init(struct vsp2_device *vsp2, int dev_id)
 	return 0;
 }
 
-static void vsp2_vspm_free(struct vsp2_device *vsp2)
-{
-	struct vsp_start_t *vsp_par = vsp2->vspm->ip_par.par.vsp;
-
-	/* dl_par */
-	dma_free_coherent(
-		vsp2->dev,
-		(128 + 2048) * 8,
-		vsp_par->dl_par.virt_addr,
-		(dma_addr_t)(vsp_par->dl_par.hard_addr));
-}
-
 void vsp2_vspm_exit(struct vsp2_device *vsp2)
 {
 	vsp2_vspm_free(vsp2);
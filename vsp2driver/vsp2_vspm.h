@@ -58,8 +58,12 @@
 #ifndef __VSP2_VSPM_H__
 #define __VSP2_VSPM_H__
 
+#include <linux/completion.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/videodev2.h>
+#include <linux/wait.h>
 #include <linux/workqueue.h>
 
 #include "vsp2_device.h"
@@ -68,17 +72,88 @@
 #define VSP2_VSPM_JOB_PRI_0	(VSPM_PRI_MAX)		/* for vsp2.0 */
 #define VSP2_VSPM_JOB_PRI_1	(VSPM_PRI_MAX)		/* for vsp2.1 */
 
-struct vsp2_vspm_entry_work {
+#define VSP2_VSPM_DL_NUM	(128 + 2048)		/* display list entries */
+
+/* Input pixels shared by the two halves of a split frame for the UDS taps. */
+#define VSP2_VSPM_SPLIT_OVERLAP	(8)
+
+/*
+ * struct vsp2_vspm_job_par - Storage for the parameters of one VSPM job
+ *
+ * The parameters built by the entities are copied here when a job is handed
+ * to a channel, so that the next job can be prepared while this one is still
+ * being processed.
+ */
+struct vsp2_vspm_job_par {
+	struct vsp_start_t start;
+	struct vsp_src_t src[5];
+	struct vsp_alpha_unit_t alpha[5];
+	struct vsp_mult_unit_t mult[5];
+	struct vsp_irop_unit_t irop[5];
+	struct vsp_ckey_unit_t ckey[5];
+	struct vsp_dl_t clut[5];
+	struct vsp_dst_t dst;
+	struct fcp_info_t fcp;
+	struct vsp_ctrl_t ctrl;
+	struct vsp_sru_t sru;
+	struct vsp_uds_t uds;
+	struct vsp_lut_t lut;
+	struct vsp_clu_t clu;
+	struct vsp_hst_t hst;
+	struct vsp_hsi_t hsi;
+	struct vsp_hgo_t hgo;
+	struct vsp_hgt_t hgt;
+	struct vsp_shp_t shp;
+	struct vsp_bru_t bru;
+	struct vsp_bld_vir_t bru_virtual;
+	struct vsp_bld_ctrl_t bru_blend[5];
+	struct vsp_bld_rop_t bru_rop;
+	struct vsp_brs_t brs;
+	struct vsp_bld_vir_t brs_virtual;
+	struct vsp_bld_ctrl_t brs_blend[2];
+};
+
+/*
+ * struct vsp2_vspm_ch - A VSPM channel
+ * @work: work entering the job to the VSPM driver
+ * @vsp2: the VSP2 device
+ * @hdl: VSPM handle of the channel
+ * @job_id: VSPM job ID of the job in flight
+ * @ip_par: VSPM job parameters of the job in flight
+ * @par: storage for the parameters pointed to by @ip_par
+ * @busy: a job has been handed to the channel
+ * @done: the job handed to the channel has completed
+ * @seq: pipeline sequence number of the job in flight
+ * @sync: completion of a synchronous job, NULL for pipeline jobs
+ * @result: VSPM result of the job
+ */
+struct vsp2_vspm_ch {
 	struct work_struct work;
 	struct vsp2_device *vsp2;
-};
 
-struct vsp2_vspm {
 	void *hdl;
 	unsigned long job_id;
+	struct vspm_job_t ip_par;
+	struct vsp2_vspm_job_par *par;
+
+	bool busy;
+	bool done;
+	unsigned int seq;
+
+	struct completion *sync;
+	long result;
+};
+
+struct vsp2_vspm {
 	char job_pri;
 	struct vspm_job_t ip_par;
-	struct vsp2_vspm_entry_work entry_work;
+	unsigned char zpos[5];		/* stacking position of each RPF */
+	struct vsp_ckey_unit_t ckey[5];	/* color key of each RPF */
+
+	spinlock_t lock;	/* protects the channels state */
+	wait_queue_head_t ch_wait;	/* signalled when a channel is freed */
+	unsigned int ch_count;
+	struct vsp2_vspm_ch ch[VSP2_COUNT_CH];
 };
 
 int vsp2_vspm_init(struct vsp2_device *vsp2, int dev_id);
@@ -87,6 +162,12 @@ void vsp2_vspm_param_init(struct vspm_job_t *par);
 
 long vsp2_vspm_drv_init(struct vsp2_device *vsp2);
 long vsp2_vspm_drv_quit(struct vsp2_device *vsp2);
-void vsp2_vspm_drv_entry(struct vsp2_device *vsp2);
+int vsp2_vspm_drv_entry(struct vsp2_device *vsp2, unsigned int seq,
+			bool split, const struct v4l2_rect *damage);
+int vsp2_vspm_job_run(struct vsp2_device *vsp2,
+		      const struct vsp_start_t *vsp_par);
+
+unsigned int vsp2_vspm_free_channels(struct vsp2_device *vsp2);
+bool vsp2_vspm_job_retire(struct vsp2_device *vsp2, unsigned int seq);
 
 #endif /* __VSP2_VSPM_H__ */
@@ -360,6 +360,39 @@ static void set_rotation(struct vsp2_rwpf *wpf, bool hflip,
 	mutex_unlock(&wpf->entity.lock);
 }
 
+/* Store the bounding box of the damage rectangles, empty for the full frame. */
+static void set_damage(struct vsp2_rwpf *wpf, const u16 *rects)
+{
+	struct vsp2_video *video = wpf->video;
+	unsigned int left = WPF_MAX_WIDTH;
+	unsigned int top = WPF_MAX_HEIGHT;
+	unsigned int right = 0;
+	unsigned int bottom = 0;
+	unsigned long flags;
+	unsigned int i;
+
+	for (i = 0; i < VSP2_DAMAGE_MAX_RECTS; i++, rects += 4) {
+		if (!rects[2] || !rects[3])
+			continue;
+
+		left = min_t(unsigned int, left, rects[0]);
+		top = min_t(unsigned int, top, rects[1]);
+		right = max_t(unsigned int, right, rects[0] + rects[2]);
+		bottom = max_t(unsigned int, bottom, rects[1] + rects[3]);
+	}
+
+	spin_lock_irqsave(&video->irqlock, flags);
+	if (right > left && bottom > top) {
+		wpf->damage.left = left;
+		wpf->damage.top = top;
+		wpf->damage.width = right - left;
+		wpf->damage.height = bottom - top;
+	} else {
+		memset(&wpf->damage, 0, sizeof(wpf->damage));
+	}
+	spin_unlock_irqrestore(&video->irqlock, flags);
+}
+
 static int vsp2_wpf_s_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct vsp2_rwpf *wpf = container_of(ctrl->handler,
@@ -380,6 +413,17 @@ static int vsp2_wpf_s_ctrl(struct v4l2_ctrl *ctrl)
 				     wpf->rotinfo.rotangle->val);
 		mutex_unlock(&video->lock);
 		break;
+	case VSP2_CID_SPLIT:
+		mutex_lock(&video->lock);
+		if (vb2_is_busy(&video->queue))
+			ret = -EBUSY;
+		else
+			wpf->split = ctrl->val;
+		mutex_unlock(&video->lock);
+		break;
+	case VSP2_CID_DAMAGE:
+		set_damage(wpf, ctrl->p_new.p_u16);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -397,6 +441,29 @@ static const struct v4l2_ctrl_ops vsp2_wpf_ctrl_ops = {
 	.s_ctrl = vsp2_wpf_s_ctrl,
 };
 
+static const struct v4l2_ctrl_config wpf_split_ctrl = {
+	.ops = &vsp2_wpf_ctrl_ops,
+	.id = VSP2_CID_SPLIT,
+	.name = "Split Mode",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.min = 0,
+	.max = 1,
+	.step = 1,
+	.def = 0,
+};
+
+static const struct v4l2_ctrl_config wpf_damage_ctrl = {
+	.ops = &vsp2_wpf_ctrl_ops,
+	.id = VSP2_CID_DAMAGE,
+	.name = "Damage Rectangles",
+	.type = V4L2_CTRL_TYPE_U16,
+	.min = 0,
+	.max = WPF_MAX_WIDTH,
+	.step = 1,
+	.def = 0,
+	.dims = { VSP2_DAMAGE_MAX_RECTS, 4 },
+};
+
 /* -----------------------------------------------------------------------------
  * Initialization and Cleanup
  */
@@ -441,6 +508,8 @@ struct vsp2_rwpf *vsp2_wpf_create(struct vsp2_device *vsp2, unsigned int index)
 						  &vsp2_wpf_ctrl_ops,
 						  V4L2_CID_ROTATE,
 						  0, 270, 90, 0);
+	v4l2_ctrl_new_custom(&wpf->ctrls, &wpf_split_ctrl, NULL);
+	v4l2_ctrl_new_custom(&wpf->ctrls, &wpf_damage_ctrl, NULL);
 	if (wpf->ctrls.error) {
 		ret = wpf->ctrls.error;
 		goto error;